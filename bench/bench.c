@@ -0,0 +1,1007 @@
+/**
+ * bench.c
+ *
+ * This file is part of the UKHASNet (ukhas.net) maintained RFM69 library for
+ * use with all UKHASnet nodes, including Arduino, AVR and ARM.
+ *
+ * Host-side benchmark for the public API. Each call is run against the
+ * RFM69 emulator in spi_conf/sim/ and the SPI traffic it generates is
+ * reported: slave select cycles, calls into the SPI driver, octets clocked,
+ * time spent on the bus at the chosen SCK rate, total simulated time
+ * (including waiting on the radio) and host wall time.
+ *
+ * Usage: bench [-n iterations] [-s sck_hz] [-l payload_len]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ukhasnet-rfm69.h"
+#include "ukhasnet-rfm69-hop.h"
+#include "spi_conf.h"
+
+/* Counters captured before and after a call */
+typedef struct bench_sample_t {
+    rfm69_sim_stats_t stats;
+    uint64_t sim_ns;
+    uint64_t host_ns;
+} bench_sample_t;
+
+/* Accumulated results for one API call */
+typedef struct bench_result_t {
+    const char* name;
+    uint32_t runs;
+    uint64_t spi_calls;
+    uint64_t ss_cycles;
+    uint64_t spi_bytes;
+    uint64_t sim_ns;
+    uint64_t host_ns;
+} bench_result_t;
+
+static uint32_t _iterations = 100;
+static uint8_t _payload_len = 32;
+
+static uint64_t _host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The emulated radio whose counters are sampled */
+static rfm69_sim_t* _sim = &rfm69_sim;
+
+static void _sample(bench_sample_t* s)
+{
+    s->stats = _sim->stats;
+    s->sim_ns = _sim->now_ns;
+    s->host_ns = _host_ns();
+}
+
+static void _accumulate(bench_result_t* r, const bench_sample_t* a,
+        const bench_sample_t* b)
+{
+    r->runs++;
+    r->spi_calls += b->stats.spi_calls - a->stats.spi_calls;
+    r->ss_cycles += b->stats.ss_cycles - a->stats.ss_cycles;
+    r->spi_bytes += b->stats.spi_bytes - a->stats.spi_bytes;
+    r->sim_ns += b->sim_ns - a->sim_ns;
+    r->host_ns += b->host_ns - a->host_ns;
+}
+
+static void _report(const bench_result_t* r)
+{
+    double n = r->runs ? r->runs : 1;
+    double bus_us = (r->spi_bytes / n) * 8.0 * 1e6 / rfm69_sim.sck_hz;
+
+    printf("%-22s %8.1f %8.1f %8.1f %10.1f %12.1f %10.2f\n", r->name,
+            r->ss_cycles / n, r->spi_calls / n, r->spi_bytes / n, bus_us,
+            r->sim_ns / n / 1000.0, r->host_ns / n / 1000.0);
+}
+
+/* Let the radio sit idle until a queued frame has been fully received */
+static bool _wait_payload(void)
+{
+    uint64_t limit = rfm69_sim.now_ns + 2000000000ULL;
+
+    while (!rfm69_sim.payload_ready && rfm69_sim.now_ns < limit)
+        rfm69_sim_advance(&rfm69_sim, rfm69_sim_byte_ns(&rfm69_sim));
+    return rfm69_sim.payload_ready;
+}
+
+static void _bench_init(void)
+{
+    bench_result_t r = { "rf69_init", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    uint32_t i;
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_init();
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+static void _bench_send(const uint8_t power, const rfm_reg_t mode,
+        const char* name)
+{
+    bench_result_t r = { name, 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t payload[RFM69_FIFO_SIZE];
+    uint32_t i;
+
+    memset(payload, 'A', sizeof(payload));
+    rf69_set_mode(mode);
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_send(payload, _payload_len, power);
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+static void _bench_send_async(void)
+{
+    bench_result_t r = { "rf69_send_start", 0, 0, 0, 0, 0, 0 };
+    bench_result_t p = { "rf69_send_poll (isr)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t payload[RFM69_FIFO_SIZE];
+    bool done;
+    uint32_t i;
+
+    memset(payload, 'D', sizeof(payload));
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_send_start(payload, _payload_len, 10);
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+
+        /* The application gets on with other work until DIO0 rises */
+        while (!rfm69_sim_dio0(&rfm69_sim))
+            rfm69_sim_advance(&rfm69_sim, rfm69_sim_byte_ns(&rfm69_sim));
+        rf69_dio0_isr();
+
+        _sample(&a);
+        rf69_send_poll(&done);
+        _sample(&b);
+        if (!done) {
+            fprintf(stderr, "send %u did not complete\n", (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&p, &a, &b);
+    }
+    _report(&r);
+    _report(&p);
+}
+
+static void _bench_csma(void)
+{
+    bench_result_t c = { "rf69_send_start (lbt)", 0, 0, 0, 0, 0, 0 };
+    bench_result_t b = { "rf69_send (lbt, busy)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t s0, s1;
+    rfm_reg_t payload[RFM69_FIFO_SIZE], noise[100];
+    rf69_csma_stats_t stats;
+    bool done;
+    uint32_t i;
+
+    memset(payload, 'C', sizeof(payload));
+    memset(noise, 'N', sizeof(noise));
+    rf69_set_csma(true, -90);
+    rf69_csma_stats(&stats, true);
+    rf69_set_mode(RFM69_MODE_RX);
+
+    /* Clear channel, already receiving */
+    for (i = 0; i < _iterations; i++) {
+        _sample(&s0);
+        rf69_send_start(payload, _payload_len, 10);
+        _sample(&s1);
+        _accumulate(&c, &s0, &s1);
+
+        do {
+            rfm69_sim_advance(&rfm69_sim, rfm69_sim_byte_ns(&rfm69_sim));
+            rf69_send_poll(&done);
+        } while (!done);
+    }
+
+    /* Another node keys up just before us. Its frame is too long for our
+     * PayloadLength, so it doesn't end up in our FIFO. */
+    for (i = 0; i < _iterations; i++) {
+        rfm69_sim_inject(&rfm69_sim, noise, sizeof(noise), -60,
+                rfm69_sim.now_ns);
+        _sample(&s0);
+        if (rf69_send(payload, _payload_len, 10) != RFM_OK) {
+            fprintf(stderr, "lbt send %u failed\n", (unsigned)i);
+            exit(1);
+        }
+        _sample(&s1);
+        _accumulate(&b, &s0, &s1);
+    }
+
+    rf69_csma_stats(&stats, true);
+    rf69_set_csma(false, -90);
+    if (stats.clear != 2 * _iterations || stats.busy < _iterations) {
+        fprintf(stderr, "lbt saw %u clear, %u busy\n",
+                (unsigned)stats.clear, (unsigned)stats.busy);
+        exit(1);
+    }
+
+    _report(&c);
+    _report(&b);
+}
+
+static void _bench_send_long(void)
+{
+    bench_result_t r = { "rf69_send (255, poll)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t payload[255];
+    rfm69_sim_txframe_t frame;
+    uint32_t underruns, i;
+    bool done;
+
+    memset(payload, 'L', sizeof(payload));
+    rf69_set_mode(RFM69_MODE_RX);
+    underruns = rfm69_sim.stats.tx_underruns;
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_send_start(payload, sizeof(payload), 10);
+        /* Poll once every four octets on air, as a main loop would */
+        do {
+            rfm69_sim_advance(&rfm69_sim, 4 * rfm69_sim_byte_ns(&rfm69_sim));
+            rf69_send_poll(&done);
+        } while (!done);
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+
+        if (!rfm69_sim_last_tx(&rfm69_sim, &frame)
+                || frame.len != sizeof(payload)
+                || memcmp(frame.data, payload, sizeof(payload))
+                || rfm69_sim.stats.tx_underruns != underruns) {
+            fprintf(stderr, "long send %u corrupted\n", (unsigned)i);
+            exit(1);
+        }
+    }
+    _report(&r);
+}
+
+static void _bench_tx_flush(void)
+{
+    bench_result_t r = { "rf69_tx_flush", 0, 0, 0, 0, 0, 0 };
+    bench_result_t q = { "rf69_send x queue", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t payload[RFM69_FIFO_SIZE];
+    uint32_t i;
+    uint8_t j;
+
+    memset(payload, 'E', sizeof(payload));
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        for (j = 0; j < RFM69_TX_QUEUE_SIZE; j++)
+            rf69_tx_queue(payload, _payload_len);
+        _sample(&a);
+        rf69_tx_flush(10);
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+
+        /* The same batch as individual sends, for comparison */
+        _sample(&a);
+        for (j = 0; j < RFM69_TX_QUEUE_SIZE; j++)
+            rf69_send(payload, _payload_len, 10);
+        _sample(&b);
+        _accumulate(&q, &a, &b);
+    }
+    _report(&r);
+    _report(&q);
+}
+
+static void _bench_receive_idle(void)
+{
+    bench_result_t r = { "rf69_receive (idle)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    int16_t rssi;
+    bool waiting;
+    uint32_t i;
+
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_receive(buf, &len, &rssi, &waiting);
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+static void _bench_receive_packet(void)
+{
+    bench_result_t r = { "rf69_receive (packet)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    uint8_t payload[RFM69_FIFO_SIZE];
+    int16_t rssi;
+    bool waiting;
+    uint32_t i;
+
+    memset(payload, 'B', sizeof(payload));
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        rfm69_sim_inject(&rfm69_sim, payload, _payload_len, -70,
+                rfm69_sim.now_ns + 1000000ULL);
+        if (!_wait_payload()) {
+            fprintf(stderr, "frame %u was not received\n", (unsigned)i);
+            exit(1);
+        }
+        _sample(&a);
+        rf69_receive(buf, &len, &rssi, &waiting);
+        _sample(&b);
+        if (!waiting) {
+            fprintf(stderr, "frame %u was not collected\n", (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+static void _bench_receive_info(void)
+{
+    bench_result_t r = { "rf69_receive_info", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    uint8_t payload[RFM69_FIFO_SIZE];
+    rf69_rx_info_t info;
+    bool waiting;
+    uint32_t i;
+
+    memset(payload, 'I', sizeof(payload));
+    rf69_set_mode(RFM69_MODE_RX);
+
+    /* A transmitter whose crystal is a few ppm out, which the FEI should
+     * measure to within an Fstep */
+    rfm69_sim.offset_hz = -3000;
+    for (i = 0; i < _iterations; i++) {
+        rfm69_sim_inject(&rfm69_sim, payload, _payload_len, -75,
+                rfm69_sim.now_ns + 1000000ULL);
+        if (!_wait_payload()) {
+            fprintf(stderr, "frame %u was not received\n", (unsigned)i);
+            exit(1);
+        }
+        _sample(&a);
+        rf69_receive_info(buf, &len, &info, &waiting);
+        _sample(&b);
+        if (!waiting || info.rssi != -75 || info.fei_hz < -3000 - 62
+                || info.fei_hz > -3000 + 62 || info.afc_hz != info.fei_hz) {
+            fprintf(stderr, "frame %u: rssi %d, fei %ld, afc %ld\n",
+                    (unsigned)i, info.rssi, (long)info.fei_hz,
+                    (long)info.afc_hz);
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+    }
+    rfm69_sim.offset_hz = 0;
+    _report(&r);
+}
+
+/* A pool of packet slots for rf69_receive_sink() to fill */
+static rf69_packet_t _pool[2];
+static uint8_t _pool_next;
+
+static rfm_reg_t* _pool_sink(void* ctx, uint8_t len, int16_t rssi)
+{
+    rf69_packet_t* pkt = &_pool[_pool_next++ & 1];
+
+    (void)ctx;
+    pkt->len = len;
+    pkt->rssi = rssi;
+    return pkt->data;
+}
+
+static void _bench_receive_sink(void)
+{
+    bench_result_t r = { "rf69_receive_sink", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    uint8_t payload[RFM69_FIFO_SIZE];
+    const rf69_packet_t* pkt;
+    bool waiting;
+    uint32_t i;
+
+    memset(payload, 'P', sizeof(payload));
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        rfm69_sim_inject(&rfm69_sim, payload, _payload_len, -70,
+                rfm69_sim.now_ns + 1000000ULL);
+        if (!_wait_payload()) {
+            fprintf(stderr, "frame %u was not received\n", (unsigned)i);
+            exit(1);
+        }
+        _sample(&a);
+        rf69_receive_sink(_pool_sink, NULL, &waiting);
+        _sample(&b);
+        pkt = &_pool[(_pool_next - 1) & 1];
+        if (!waiting || pkt->len != _payload_len
+                || memcmp(pkt->data, payload, pkt->len)) {
+            fprintf(stderr, "frame %u was not collected\n", (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+static void _bench_receive_stream(void)
+{
+    bench_result_t r = { "rf69_receive_stream", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t buf[255];
+    uint8_t payload[255], len;
+    int16_t rssi;
+    bool waiting;
+    uint32_t i;
+
+    memset(payload, 'S', sizeof(payload));
+    rf69_receive_stream(buf, sizeof(buf), &len, &rssi, &waiting);
+
+    for (i = 0; i < _iterations; i++) {
+        rfm69_sim_inject(&rfm69_sim, payload, sizeof(payload), -70,
+                rfm69_sim.now_ns + 1000000ULL);
+        /* Poll once every eight octets on air until the frame is in */
+        _sample(&a);
+        do {
+            rfm69_sim_advance(&rfm69_sim, 8 * rfm69_sim_byte_ns(&rfm69_sim));
+            rf69_receive_stream(buf, sizeof(buf), &len, &rssi, &waiting);
+        } while (!waiting);
+        _sample(&b);
+        if (len != sizeof(payload) || memcmp(buf, payload, len)) {
+            fprintf(stderr, "frame %u was corrupted\n", (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+static void _bench_receive_isr(void)
+{
+    bench_result_t r = { "rf69_dio0_isr", 0, 0, 0, 0, 0, 0 };
+    bench_result_t p = { "rf69_receive_pop", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    uint8_t payload[RFM69_FIFO_SIZE];
+    int16_t rssi;
+    bool waiting;
+    uint32_t i;
+
+    memset(payload, 'C', sizeof(payload));
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        rfm69_sim_inject(&rfm69_sim, payload, _payload_len, -70,
+                rfm69_sim.now_ns + 1000000ULL);
+        if (!_wait_payload() || !rfm69_sim_dio0(&rfm69_sim)) {
+            fprintf(stderr, "frame %u did not raise DIO0\n", (unsigned)i);
+            exit(1);
+        }
+        _sample(&a);
+        rf69_dio0_isr();
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+
+        _sample(&a);
+        rf69_receive_pop(buf, &len, &rssi, &waiting);
+        _sample(&b);
+        if (!waiting) {
+            fprintf(stderr, "frame %u was not queued\n", (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&p, &a, &b);
+    }
+    _report(&r);
+    _report(&p);
+}
+
+static void _bench_second_radio(void)
+{
+    bench_result_t r = { "rf69_dev_receive (2nd)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    static rfm69_sim_t sim2;
+    rf69_dev_t dev2;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    uint8_t payload[RFM69_FIFO_SIZE];
+    int16_t rssi;
+    bool waiting;
+    uint32_t i;
+
+    memset(payload, 'T', sizeof(payload));
+    rfm69_sim_init(&sim2);
+    sim2.sck_hz = rfm69_sim.sck_hz;
+    if (rf69_dev_init(&dev2, &spi_sim_ops, &sim2) != RFM_OK) {
+        fprintf(stderr, "second radio did not start\n");
+        exit(1);
+    }
+    rf69_set_mode(RFM69_MODE_RX);
+    rf69_dev_set_mode(&dev2, RFM69_MODE_RX);
+
+    _sim = &sim2;
+    for (i = 0; i < _iterations; i++) {
+        rfm69_sim_inject(&sim2, payload, _payload_len, -70,
+                sim2.now_ns + 1000000ULL);
+        while (!sim2.payload_ready)
+            rfm69_sim_advance(&sim2, rfm69_sim_byte_ns(&sim2));
+        _sample(&a);
+        rf69_dev_receive(&dev2, buf, &len, &rssi, &waiting);
+        _sample(&b);
+        if (!waiting || len != _payload_len + 1) {
+            fprintf(stderr, "frame %u was not collected\n", (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+
+        /* Nothing was sent to the first radio */
+        rf69_receive(buf, &len, &rssi, &waiting);
+        if (waiting) {
+            fprintf(stderr, "frame %u went to the wrong radio\n",
+                    (unsigned)i);
+            exit(1);
+        }
+    }
+    _sim = &rfm69_sim;
+    _report(&r);
+}
+
+static void _bench_retune(void)
+{
+    bench_result_t f = { "rf69_set_frequency", 0, 0, 0, 0, 0, 0 };
+    bench_result_t p = { "rf69_apply_profile", 0, 0, 0, 0, 0, 0 };
+    static const rf69_profile_t profiles[2] = {
+        RFM69_PROFILE(869500000UL, 2000UL, 12000UL, 125000UL),
+        RFM69_PROFILE(869850000UL, 4800UL, 20000UL, 125000UL)
+    };
+    bench_sample_t a, b;
+    uint32_t i;
+
+    /* Hop between two channels 25kHz apart while receiving */
+    rf69_set_mode(RFM69_MODE_RX);
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_set_frequency(i & 1 ? 869525000UL : 869500000UL);
+        _sample(&b);
+        _accumulate(&f, &a, &b);
+    }
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_apply_profile(&profiles[i & 1]);
+        _sample(&b);
+        _accumulate(&p, &a, &b);
+    }
+    rf69_apply_profile(&profiles[0]);
+    if (rfm69_sim_bitrate(&rfm69_sim) != 2000) {
+        fprintf(stderr, "profile was not applied\n");
+        exit(1);
+    }
+
+    _report(&f);
+    _report(&p);
+}
+
+static void _bench_listen(void)
+{
+    bench_result_t l = { "rf69_listen_start", 0, 0, 0, 0, 0, 0 };
+    bench_result_t r = { "rf69_receive (listen)", 0, 0, 0, 0, 0, 0 };
+    bench_result_t s = { "rf69_send (listen)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    uint8_t payload[RFM69_FIFO_SIZE];
+    int16_t rssi;
+    bool waiting;
+    uint32_t i;
+
+    memset(payload, 'L', sizeof(payload));
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_listen_start(100000, 2000, RF_LISTEN1_CRITERIA_RSSI);
+        _sample(&b);
+        _accumulate(&l, &a, &b);
+
+        /* Repeat the frame until an Rx period catches it */
+        while (!rfm69_sim.payload_ready) {
+            if (!rfm69_sim.air_count)
+                rfm69_sim_inject(&rfm69_sim, payload, _payload_len, -70,
+                        rfm69_sim.now_ns);
+            rfm69_sim_advance(&rfm69_sim, rfm69_sim_byte_ns(&rfm69_sim));
+        }
+        rfm69_sim.air_count = 0;
+
+        _sample(&a);
+        rf69_receive(buf, &len, &rssi, &waiting);
+        _sample(&b);
+        if (!waiting || !rfm69_sim.listen) {
+            fprintf(stderr, "listen frame %u was not collected\n",
+                    (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+    }
+
+    /* A high power send leaves Listen mode for as long as it needs the
+     * radio, and the receiver never wakes with the PA boost on */
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_send(payload, _payload_len, 20);
+        _sample(&b);
+        if (!rfm69_sim.listen || rfm69_sim.stats.pa_boost_rx) {
+            fprintf(stderr, "send %u while listening: listen %d, %u "
+                    "boosted receives\n", (unsigned)i, rfm69_sim.listen,
+                    (unsigned)rfm69_sim.stats.pa_boost_rx);
+            exit(1);
+        }
+        _accumulate(&s, &a, &b);
+    }
+    rf69_listen_stop();
+
+    _report(&l);
+    _report(&r);
+    _report(&s);
+}
+
+static void _bench_aes(void)
+{
+    bench_result_t k = { "rf69_set_aes_key (rx)", 0, 0, 0, 0, 0, 0 };
+    bench_result_t t = { "rf69_set_aes (toggle)", 0, 0, 0, 0, 0, 0 };
+    static const rfm_reg_t key[RFM69_AES_KEY_SIZE] = "ukhasnet-aes-key";
+    bench_sample_t a, b;
+    uint32_t i;
+
+    rf69_set_mode(RFM69_MODE_RX);
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_set_aes_key(key);
+        _sample(&b);
+        _accumulate(&k, &a, &b);
+
+        _sample(&a);
+        rf69_set_aes(!(i & 1));
+        _sample(&b);
+        _accumulate(&t, &a, &b);
+    }
+    rf69_set_aes(false);
+
+    _report(&k);
+    _report(&t);
+}
+
+static void _bench_filtered(void)
+{
+    bench_result_t r = { "rf69_receive (filter)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    uint8_t payload[RFM69_FIFO_SIZE];
+    uint64_t start_ns;
+    uint32_t i, filtered;
+    int16_t rssi;
+    bool waiting;
+
+    memset(payload, 'F', sizeof(payload));
+    rf69_set_address(0x11, 0xFF, RF_PACKET1_ADRSFILTERING_NODEBROADCAST);
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        /* A frame for another node, then one for this node */
+        filtered = rfm69_sim.stats.frames_filtered;
+        start_ns = rfm69_sim.now_ns + 1000000ULL;
+        payload[0] = 0x22;
+        rfm69_sim_inject(&rfm69_sim, payload, _payload_len, -70, start_ns);
+        payload[0] = 0x11;
+        rfm69_sim_inject(&rfm69_sim, payload, _payload_len, -70,
+                start_ns + (_payload_len + 16) * rfm69_sim_byte_ns(&rfm69_sim));
+
+        /* The first never reaches the FIFO */
+        while (rfm69_sim.stats.frames_filtered == filtered)
+            rfm69_sim_advance(&rfm69_sim, rfm69_sim_byte_ns(&rfm69_sim));
+
+        _sample(&a);
+        rf69_receive(buf, &len, &rssi, &waiting);
+        _sample(&b);
+        if (waiting) {
+            fprintf(stderr, "frame %u was not filtered\n", (unsigned)i);
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+
+        if (!_wait_payload())
+            exit(1);
+        rf69_receive(buf, &len, &rssi, &waiting);
+        if (!waiting || buf[0] != 0x11) {
+            fprintf(stderr, "frame %u was not collected\n", (unsigned)i);
+            exit(1);
+        }
+    }
+    rf69_set_address(0x00, 0x00, RF_PACKET1_ADRSFILTERING_OFF);
+
+    _report(&r);
+}
+
+static void _bench_read_temp(void)
+{
+    bench_result_t r = { "rf69_read_temp", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    int8_t temperature;
+    uint32_t i;
+
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_read_temp(&temperature);
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+static void _bench_temp_poll(void)
+{
+    bench_result_t p = { "rf69_temp_start/poll", 0, 0, 0, 0, 0, 0 };
+    bench_result_t c = { "rf69_temp_cached", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    int8_t temperature;
+    uint32_t i, age;
+    bool done;
+
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_temp_start();
+        do {
+            rf69_temp_poll(&done, &temperature);
+        } while (!done);
+        _sample(&b);
+        _accumulate(&p, &a, &b);
+
+        _sample(&a);
+        rf69_temp_cached(&temperature, &age);
+        _sample(&b);
+        _accumulate(&c, &a, &b);
+    }
+    _report(&p);
+    _report(&c);
+}
+
+static void _bench_rssi_sweep(void)
+{
+    bench_result_t r = { "rf69_rssi_sweep (9 ch)", 0, 0, 0, 0, 0, 0 };
+    int16_t out[RFM69_SWEEP_POINTS(869400000UL, 869600000UL, 25000UL)];
+    bench_sample_t a, b;
+    uint32_t i;
+    uint8_t j;
+
+    /* Something parked on the channel 50kHz above ours */
+    rfm69_sim_interferer(&rfm69_sim, 869550000UL, 20000UL, -60);
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_rssi_sweep(869400000UL, 869600000UL, 25000UL, out);
+        _sample(&b);
+        for (j = 0; j < sizeof(out) / sizeof(out[0]); j++) {
+            if (out[j] != (j == 6 ? -60 : RFM69_SIM_NOISE_DBM)) {
+                fprintf(stderr, "sweep point %u read %d dBm\n",
+                        (unsigned)j, out[j]);
+                exit(1);
+            }
+        }
+        _accumulate(&r, &a, &b);
+    }
+    rfm69_sim.interferer_count = 0;
+
+    if (rfm69_sim_frequency(&rfm69_sim) / 1000 != 869500) {
+        fprintf(stderr, "sweep left the radio on %lu Hz\n",
+                (unsigned long)rfm69_sim_frequency(&rfm69_sim));
+        exit(1);
+    }
+    _report(&r);
+}
+
+static void _bench_sample_rssi(void)
+{
+    bench_result_t r = { "rf69_sample_rssi", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    int16_t rssi;
+    uint32_t i;
+
+    rf69_set_mode(RFM69_MODE_RX);
+
+    for (i = 0; i < _iterations; i++) {
+        _sample(&a);
+        rf69_sample_rssi(&rssi);
+        _sample(&b);
+        _accumulate(&r, &a, &b);
+    }
+    _report(&r);
+}
+
+/* Hop plan for the frequency hopping rows: 8 channels 250kHz apart, wider
+ * than the receiver so that each is only heard on its own channel */
+#define HOP_BASE_HZ     863250000UL
+#define HOP_SPACING_HZ  250000UL
+#define HOP_CHANNELS    8
+#define HOP_DWELL_MS    100
+#define HOP_SEED        0x55AA1234UL
+
+static uint32_t _sim_ms(void)
+{
+    return rfm69_sim.now_ns / 1000000ULL;
+}
+
+static void _check_channel(const rf69_hop_t* hop, const char* what)
+{
+    uint32_t hz = HOP_BASE_HZ + HOP_SPACING_HZ * rf69_hop_channel(hop);
+
+    if ((rfm69_sim_frequency(&rfm69_sim) + 500) / 1000 != hz / 1000) {
+        fprintf(stderr, "%s left the radio on %lu Hz, not %lu Hz\n", what,
+                (unsigned long)rfm69_sim_frequency(&rfm69_sim),
+                (unsigned long)hz);
+        exit(1);
+    }
+}
+
+static void _bench_hop_tick(void)
+{
+    bench_result_t r = { "rf69_hop_tick (retune)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rf69_hop_t hop;
+    uint32_t i;
+
+    /* A transmitter parked in FS between packets */
+    rf69_hop_init(&hop, NULL, HOP_BASE_HZ, HOP_SPACING_HZ,
+            HOP_CHANNELS, HOP_DWELL_MS, HOP_SEED);
+    rf69_hop_start(&hop, _sim_ms(), false);
+
+    for (i = 0; i < _iterations; i++) {
+        while ((int32_t)(_sim_ms() - hop.next_ms) < 0)
+            rfm69_sim_advance(&rfm69_sim, 1000000ULL);
+        _sample(&a);
+        rf69_hop_tick(&hop, _sim_ms());
+        _sample(&b);
+        _check_channel(&hop, "rf69_hop_tick");
+        _accumulate(&r, &a, &b);
+    }
+    rf69_set_mode(RFM69_MODE_STDBY);
+    _report(&r);
+}
+
+static void _bench_hop_scan(void)
+{
+    bench_result_t r = { "rf69_hop_scan (lock)", 0, 0, 0, 0, 0, 0 };
+    bench_sample_t a, b;
+    rf69_hop_t hop;
+    rfm_reg_t buf[RFM69_FIFO_SIZE], len;
+    uint8_t payload[2];
+    uint32_t i, t0, sent, slot, air_ms;
+    int16_t rssi;
+    bool waiting;
+
+    rf69_hop_init(&hop, NULL, HOP_BASE_HZ, HOP_SPACING_HZ,
+            HOP_CHANNELS, HOP_DWELL_MS, HOP_SEED);
+
+    /* Preamble, sync, length, payload and CRC */
+    air_ms = (3 + 2 + 1 + sizeof(payload) + 2) * 8 * 1000UL
+        / rfm69_sim_bitrate(&rfm69_sim);
+
+    for (i = 0; i < _iterations; i++) {
+        /* The receiver starts on a different channel each time, against a
+         * transmitter that sends 1ms into every dwell */
+        hop.slot = i % HOP_CHANNELS;
+        t0 = _sim_ms();
+        sent = UINT32_MAX;
+
+        _sample(&a);
+        rf69_hop_scan(&hop, _sim_ms());
+        for (;;) {
+            slot = (_sim_ms() - t0) / HOP_DWELL_MS;
+            if (slot != sent) {
+                sent = slot;
+                payload[0] = 1;
+                payload[1] = 0;
+                rfm69_sim.frame_hz = HOP_BASE_HZ + HOP_SPACING_HZ
+                    * hop.seq[slot % HOP_CHANNELS];
+                rfm69_sim_inject(&rfm69_sim, payload, sizeof(payload), -70,
+                        (uint64_t)(t0 + slot * HOP_DWELL_MS + 1)
+                        * 1000000ULL);
+            }
+            rf69_receive(buf, &len, &rssi, &waiting);
+            if (waiting)
+                break;
+            rf69_hop_tick(&hop, _sim_ms());
+            rfm69_sim_advance(&rfm69_sim, 1000000ULL);
+            if (_sim_ms() - t0 > 2 * HOP_DWELL_MS * (HOP_CHANNELS + 1)) {
+                fprintf(stderr, "scan %u found nothing\n", (unsigned)i);
+                exit(1);
+            }
+        }
+        rf69_hop_lock(&hop, _sim_ms(), buf[0] + air_ms);
+        _sample(&b);
+
+        /* Locked to within the time it took to notice the packet */
+        if (hop.next_ms - (t0 + (slot + 1) * HOP_DWELL_MS) + 2 > 4) {
+            fprintf(stderr, "scan %u locked %ld ms out\n", (unsigned)i,
+                    (long)(hop.next_ms - (t0 + (slot + 1) * HOP_DWELL_MS)));
+            exit(1);
+        }
+        _accumulate(&r, &a, &b);
+
+        /* Let the rest of the transmitter's frames go by */
+        rfm69_sim.frame_hz = 0;
+        while (rfm69_sim.air_count)
+            rfm69_sim_advance(&rfm69_sim, 1000000ULL);
+        rf69_receive(buf, &len, &rssi, &waiting);
+    }
+    _report(&r);
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+
+    rfm69_sim_init(&rfm69_sim);
+
+    while ((opt = getopt(argc, argv, "n:s:l:")) != -1) {
+        switch (opt) {
+            case 'n':
+                _iterations = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                rfm69_sim.sck_hz = strtoul(optarg, NULL, 0);
+                break;
+            case 'l':
+                _payload_len = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations] [-s sck_hz] "
+                        "[-l payload_len]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (!_iterations || !rfm69_sim.sck_hz || !_payload_len
+            || _payload_len >= RFM69_FIFO_SIZE) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    if (rf69_init() != RFM_OK) {
+        fprintf(stderr, "rf69_init failed\n");
+        return 1;
+    }
+
+    printf("sck %lu Hz, bitrate %lu bps, payload %u octets, %lu runs\n\n",
+            (unsigned long)rfm69_sim.sck_hz,
+            (unsigned long)rfm69_sim_bitrate(&rfm69_sim),
+            (unsigned)_payload_len, (unsigned long)_iterations);
+    printf("%-22s %8s %8s %8s %10s %12s %10s\n", "call", "ss", "calls",
+            "bytes", "bus us", "sim us", "host us");
+
+    _bench_init();
+    _bench_send(10, RFM69_MODE_RX, "rf69_send (10dBm)");
+    _bench_send(20, RFM69_MODE_RX, "rf69_send (20dBm)");
+    _bench_send(20, RFM69_MODE_STDBY, "rf69_send (20dBm, sby)");
+    _bench_send_async();
+    _bench_csma();
+    _bench_send_long();
+    _bench_tx_flush();
+    _bench_receive_idle();
+    _bench_receive_packet();
+    _bench_receive_info();
+    _bench_receive_sink();
+    _bench_receive_stream();
+    _bench_receive_isr();
+    _bench_second_radio();
+    _bench_retune();
+    _bench_listen();
+    _bench_aes();
+    _bench_filtered();
+    _bench_read_temp();
+    _bench_temp_poll();
+    _bench_sample_rssi();
+    _bench_rssi_sweep();
+    _bench_hop_tick();
+    _bench_hop_scan();
+
+    return 0;
+}
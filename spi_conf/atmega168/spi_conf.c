@@ -16,9 +16,15 @@
  * Based on RFM69 LowPowerLabs (https://github.com/LowPowerLab/RFM69/)
  */
 
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
 #include "ukhasnet-rfm69.h"
 #include "spi_conf.h"
 
+/* Millisecond count, incremented by the Timer0 compare interrupt */
+static volatile uint32_t _spi_millis;
+
 /**
  * User SPI setup function. Use this function to set up the SPI peripheral
  * on the microcontroller, such as to setup the IO, set the mode (0,0) for the
@@ -44,6 +50,13 @@ rfm_status_t spi_init(void)
     /* Finally, enable the SPI periph */
     SPCR |= _BV(SPE);
 
+    /* Timer0 in CTC mode, interrupting every 1ms for spi_millis().
+     * Interrupts must be enabled with sei() for it to count. */
+    TCCR0A = _BV(WGM01);
+    TCCR0B = SPI_MILLIS_CS;
+    OCR0A = SPI_MILLIS_OCR;
+    TIMSK0 |= _BV(OCIE0A);
+
     /* Return RFM_OK if everything went ok, otherwise RFM_FAIL */
     return RFM_OK;
 }
@@ -63,6 +76,26 @@ rfm_status_t spi_exchange_single(const rfm_reg_t out, rfm_reg_t* in)
     return RFM_OK;
 }
 
+/**
+ * User function to exchange a block of bytes over the SPI interface without
+ * a function call per byte
+ * @warn This does not handle SS
+ * @param out The bytes to be sent, or NULL to send 0xFF
+ * @param in Where to put the received bytes, or NULL to discard them
+ * @param len The number of bytes to exchange
+ */
+rfm_status_t spi_exchange_burst(const rfm_reg_t* out, rfm_reg_t* in,
+        uint8_t len)
+{
+    while (len--) {
+        SPDR = out ? *out++ : 0xFF;
+        while(!(SPSR & (1<<SPIF)));
+        if (in)
+            *in++ = SPDR;
+    }
+    return RFM_OK;
+}
+
 /**
  * User function to assert the slave select pin
  */
@@ -81,3 +114,21 @@ rfm_status_t spi_ss_deassert(void)
     return RFM_OK;
 }
 
+/**
+ * User function returning a free running millisecond count, kept by Timer0
+ */
+uint32_t spi_millis(void)
+{
+    uint32_t ms;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ms = _spi_millis;
+    }
+    return ms;
+}
+
+ISR(TIMER0_COMPA_vect)
+{
+    _spi_millis++;
+}
+
@@ -31,4 +31,38 @@
 #define SPI_MISO    _BV(4)
 #define SPI_SCK     _BV(5)
 
+/* We provide spi_exchange_burst() to avoid a call per byte */
+#define SPI_HAVE_EXCHANGE_BURST
+
+/*
+ * spi_millis() is kept by Timer0, which this port takes over: spi_init()
+ * puts it in CTC mode with a compare interrupt every 1ms, so it is not
+ * available to the application (or to Arduino's millis()). Interrupts must
+ * be enabled with sei() for the count to advance, otherwise no library wait
+ * ever reaches its RFM69_TIMEOUT_MS deadline.
+ *
+ * F_CPU must be given, e.g. -DF_CPU=8000000UL. The prescaler is the
+ * smallest of /8, /64 and /256 for which the count per ms fits OCR0A's 8
+ * bits, e.g. /64 at 16MHz and /256 at 20MHz. The count is rounded, so
+ * at 20MHz the tick is 0.16% short.
+ */
+#ifndef F_CPU
+#error "F_CPU must be defined for the spi_millis() tick"
+#endif
+#if ((F_CPU) + 8 * 500UL) / (8 * 1000UL) <= 256
+#define SPI_MILLIS_PRESCALE 8UL
+#define SPI_MILLIS_CS       _BV(CS01)
+#elif ((F_CPU) + 64 * 500UL) / (64 * 1000UL) <= 256
+#define SPI_MILLIS_PRESCALE 64UL
+#define SPI_MILLIS_CS       (_BV(CS01) | _BV(CS00))
+#elif ((F_CPU) + 256 * 500UL) / (256 * 1000UL) <= 256
+#define SPI_MILLIS_PRESCALE 256UL
+#define SPI_MILLIS_CS       _BV(CS02)
+#else
+#error "F_CPU is too fast for a 1ms Timer0 tick"
+#endif
+#define SPI_MILLIS_OCR \
+    (((F_CPU) + SPI_MILLIS_PRESCALE * 500UL) / (SPI_MILLIS_PRESCALE * 1000UL) \
+     - 1)
+
 #endif /* __SPI_CONF_H__ */
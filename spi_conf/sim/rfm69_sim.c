@@ -0,0 +1,1030 @@
+/**
+ * rfm69_sim.c
+ *
+ * This file is part of the UKHASNet (ukhas.net) maintained RFM69 library for
+ * use with all UKHASnet nodes, including Arduino, AVR and ARM.
+ *
+ * Software model of the RFM69. Time only moves forward when the SPI bus is
+ * clocked or when the caller explicitly advances it, so the library sees a
+ * deterministic radio whose timing follows the programmed bitrate.
+ */
+
+#include <string.h>
+
+#include "rfm69_sim.h"
+
+/* PA ramp times in microseconds, indexed by RegPaRamp */
+static const uint16_t _sim_paramp_us[16] = {
+    3400, 2000, 1000, 500, 250, 125, 100, 62,
+    50, 40, 31, 25, 20, 15, 12, 10
+};
+
+static void _sim_update(rfm69_sim_t* sim);
+static void _sim_listen_start(rfm69_sim_t* sim);
+
+/**
+ * Load the power-on-reset register values from the datasheet.
+ * @param sim The emulated radio
+ */
+static void _sim_reset_regs(rfm69_sim_t* sim)
+{
+    memset(sim->regs, 0, sizeof(sim->regs));
+    sim->regs[RFM69_REG_01_OPMODE] = RF_OPMODE_STANDBY;
+    sim->regs[RFM69_REG_03_BITRATE_MSB] = 0x1A;
+    sim->regs[RFM69_REG_04_BITRATE_LSB] = 0x0B;
+    sim->regs[RFM69_REG_06_FDEV_LSB] = 0x52;
+    sim->regs[RFM69_REG_07_FRF_MSB] = 0xE4;
+    sim->regs[RFM69_REG_08_FRF_MID] = 0xC0;
+    sim->regs[RFM69_REG_0A_OSC1] = RF_OSC1_RCCAL_DONE | 0x01;
+    sim->regs[RFM69_REG_0D_LISTEN1] = 0x92;
+    sim->regs[RFM69_REG_0E_LISTEN2] = RF_LISTEN2_COEFIDLE_VALUE;
+    sim->regs[RFM69_REG_0F_LISTEN3] = RF_LISTEN3_COEFRX_VALUE;
+    sim->regs[RFM69_REG_10_VERSION] = RFM69_SIM_VERSION;
+    sim->regs[RFM69_REG_11_PA_LEVEL] = 0x9F;
+    sim->regs[RFM69_REG_12_PA_RAMP] = RF_PARAMP_40;
+    sim->regs[RFM69_REG_13_OCP] = RF_OCP_ON | RF_OCP_TRIM_95;
+    sim->regs[RFM69_REG_18_LNA] = 0x08;
+    sim->regs[RFM69_REG_19_RX_BW] = 0x86;
+    sim->regs[RFM69_REG_1A_AFC_BW] = 0x8A;
+    sim->regs[RFM69_REG_1E_AFC_FEI] = 0x10;
+    sim->regs[RFM69_REG_26_DIO_MAPPING2] = 0x05;
+    sim->regs[RFM69_REG_29_RSSI_THRESHOLD] = RF_RSSITHRESH_VALUE;
+    sim->regs[RFM69_REG_2D_PREAMBLE_LSB] = RF_PREAMBLESIZE_LSB_VALUE;
+    sim->regs[RFM69_REG_2E_SYNC_CONFIG] = 0x98;
+    sim->regs[RFM69_REG_37_PACKET_CONFIG1] = RF_PACKET1_CRC_ON;
+    sim->regs[RFM69_REG_38_PAYLOAD_LENGTH] = RF_PAYLOADLENGTH_VALUE;
+    sim->regs[RFM69_REG_3C_FIFO_THRESHOLD] = RF_FIFOTHRESH_VALUE;
+    sim->regs[RFM69_REG_3D_PACKET_CONFIG2] = RF_PACKET2_AUTORXRESTART_ON;
+    sim->regs[RFM69_REG_4E_TEMP1] = RF_TEMP1_ADCLOWPOWER_ON;
+    sim->regs[RFM69_REG_58_TEST_LNA] = RF_TESTLNA_NORMAL;
+    sim->regs[RFM69_REG_5A_TEST_PA1] = 0x55;
+    sim->regs[RFM69_REG_5C_TEST_PA2] = 0x70;
+    sim->regs[RFM69_REG_6F_TEST_DAGC] = 0x30;
+}
+
+/**
+ * Initialise an emulated radio to its power-on state.
+ * @param sim The emulated radio
+ */
+void rfm69_sim_init(rfm69_sim_t* sim)
+{
+    memset(sim, 0, sizeof(*sim));
+    _sim_reset_regs(sim);
+    sim->sck_hz = RFM69_SIM_DEFAULT_SCK;
+    sim->mode = RF_OPMODE_STANDBY;
+    sim->temp_c = 20;
+    sim->noise_dbm = RFM69_SIM_NOISE_DBM;
+    sim->rssi_dbm = RFM69_SIM_NOISE_DBM;
+}
+
+/**
+ * Get the bitrate currently programmed into RegBitrate.
+ * @param sim The emulated radio
+ * @returns The bitrate in bits per second
+ */
+uint32_t rfm69_sim_bitrate(const rfm69_sim_t* sim)
+{
+    uint16_t br = ((uint16_t)sim->regs[RFM69_REG_03_BITRATE_MSB] << 8)
+        | sim->regs[RFM69_REG_04_BITRATE_LSB];
+    if (!br)
+        br = 1;
+    return RFM69_SIM_FXOSC / br;
+}
+
+/**
+ * Get the carrier frequency currently programmed into RegFrf.
+ * @param sim The emulated radio
+ * @returns The carrier frequency in Hz
+ */
+uint32_t rfm69_sim_frequency(const rfm69_sim_t* sim)
+{
+    uint32_t frf = ((uint32_t)sim->regs[RFM69_REG_07_FRF_MSB] << 16)
+        | ((uint32_t)sim->regs[RFM69_REG_08_FRF_MID] << 8)
+        | sim->regs[RFM69_REG_09_FRF_LSB];
+
+    return (uint64_t)frf * RFM69_SIM_FXOSC >> 19;
+}
+
+/**
+ * Get the time taken to move one octet over the air.
+ * @param sim The emulated radio
+ * @returns The octet period in nanoseconds
+ */
+uint64_t rfm69_sim_byte_ns(const rfm69_sim_t* sim)
+{
+    uint16_t br = ((uint16_t)sim->regs[RFM69_REG_03_BITRATE_MSB] << 8)
+        | sim->regs[RFM69_REG_04_BITRATE_LSB];
+    if (!br)
+        br = 1;
+    return (8ULL * 1000000000ULL * br) / RFM69_SIM_FXOSC;
+}
+
+/**
+ * Number of octets of preamble and sync word in front of each frame.
+ */
+static uint16_t _sim_header_bytes(const rfm69_sim_t* sim)
+{
+    uint16_t n = ((uint16_t)sim->regs[RFM69_REG_2C_PREAMBLE_MSB] << 8)
+        | sim->regs[RFM69_REG_2D_PREAMBLE_LSB];
+    if (sim->regs[RFM69_REG_2E_SYNC_CONFIG] & RF_SYNC_ON)
+        n += ((sim->regs[RFM69_REG_2E_SYNC_CONFIG] >> 3) & 0x07) + 1;
+    return n;
+}
+
+/**
+ * Number of octets of CRC appended to each frame.
+ */
+static uint8_t _sim_crc_bytes(const rfm69_sim_t* sim)
+{
+    return (sim->regs[RFM69_REG_37_PACKET_CONFIG1] & RF_PACKET1_CRC_ON) ? 2 : 0;
+}
+
+static bool _sim_variable_length(const rfm69_sim_t* sim)
+{
+    return sim->regs[RFM69_REG_37_PACKET_CONFIG1] & RF_PACKET1_FORMAT_VARIABLE;
+}
+
+static void _sim_fifo_clear(rfm69_sim_t* sim)
+{
+    sim->fifo_head = 0;
+    sim->fifo_count = 0;
+}
+
+static void _sim_fifo_push(rfm69_sim_t* sim, const rfm_reg_t b)
+{
+    if (sim->fifo_count == RFM69_SIM_FIFO_SIZE) {
+        sim->fifo_overrun = true;
+        sim->stats.fifo_overruns++;
+        return;
+    }
+    sim->fifo[(sim->fifo_head + sim->fifo_count) % RFM69_SIM_FIFO_SIZE] = b;
+    sim->fifo_count++;
+}
+
+static rfm_reg_t _sim_fifo_pop(rfm69_sim_t* sim)
+{
+    rfm_reg_t b;
+
+    if (!sim->fifo_count) {
+        sim->stats.fifo_underflows++;
+        return 0x00;
+    }
+    b = sim->fifo[sim->fifo_head];
+    sim->fifo_head = (sim->fifo_head + 1) % RFM69_SIM_FIFO_SIZE;
+    sim->fifo_count--;
+    return b;
+}
+
+/**
+ * The channel the receiver is listening on. In Rx, a retune only takes
+ * effect once the receiver is restarted.
+ */
+static uint32_t _sim_rx_hz(const rfm69_sim_t* sim)
+{
+    if (sim->mode == RF_OPMODE_RECEIVER)
+        return sim->rx_hz;
+    return rfm69_sim_frequency(sim);
+}
+
+/**
+ * Whether a frame on air is on the channel the radio is tuned to, i.e.
+ * within the receiver bandwidth.
+ */
+static bool _sim_on_channel(const rfm69_sim_t* sim,
+        const rfm69_sim_frame_t* f)
+{
+    uint32_t hz, d;
+
+    if (!f->hz)
+        return true;
+    hz = _sim_rx_hz(sim);
+    d = hz > f->hz ? hz - f->hz : f->hz - hz;
+    return d <= RFM69_RXBW_HZ(sim->regs[RFM69_REG_19_RX_BW] & 0x1F);
+}
+
+/**
+ * The signal level at the antenna right now.
+ */
+static int16_t _sim_rssi_now(const rfm69_sim_t* sim)
+{
+    uint64_t byte_ns = rfm69_sim_byte_ns(sim);
+    uint16_t hdr = _sim_header_bytes(sim);
+    uint8_t crc = _sim_crc_bytes(sim);
+    uint32_t hz;
+    int16_t dbm;
+    uint8_t i;
+
+    if (sim->rx_active)
+        return sim->rx_cur.rssi;
+
+    for (i = 0; i < sim->air_count; i++) {
+        const rfm69_sim_frame_t* f = &sim->air[i];
+        uint64_t end = f->start_ns + (hdr + 1 + f->len + crc) * byte_ns;
+        if (f->start_ns <= sim->now_ns && sim->now_ns < end
+                && _sim_on_channel(sim, f))
+            return f->rssi;
+    }
+
+    /* Otherwise the strongest interferer on this channel, if any rises
+     * above the noise */
+    hz = _sim_rx_hz(sim);
+    dbm = sim->noise_dbm;
+    for (i = 0; i < sim->interferer_count; i++) {
+        const rfm69_sim_interferer_t* n = &sim->interferers[i];
+        uint32_t d = hz > n->hz ? hz - n->hz : n->hz - hz;
+        if (d <= n->bw_hz / 2 && n->dbm > dbm)
+            dbm = n->dbm;
+    }
+    return dbm;
+}
+
+/**
+ * Count the receiver being run, or Listen mode being left free to wake it,
+ * with the high power PA settings on, which the datasheet forbids.
+ */
+static void _sim_check_pa(rfm69_sim_t* sim)
+{
+    if (sim->regs[RFM69_REG_5A_TEST_PA1] != 0x55
+            || sim->regs[RFM69_REG_5C_TEST_PA2] != 0x70)
+        sim->stats.pa_boost_rx++;
+}
+
+/**
+ * Convert a Listen mode resolution field (RegListen1) and coefficient into
+ * nanoseconds.
+ */
+static uint64_t _sim_listen_ns(const rfm_reg_t resol, const rfm_reg_t coef)
+{
+    static const uint64_t resol_ns[4] = { 0, 64000ULL, 4100000ULL,
+        262000000ULL };
+
+    return resol_ns[resol & 0x03] * coef;
+}
+
+/**
+ * Enter Listen mode, which cycles between idle and Rx periods starting with
+ * idle.
+ */
+static void _sim_listen_start(rfm69_sim_t* sim)
+{
+    rfm_reg_t l1 = sim->regs[RFM69_REG_0D_LISTEN1];
+
+    sim->listen = true;
+    sim->listen_start_ns = sim->now_ns;
+    sim->listen_idle_ns = _sim_listen_ns(l1 >> 6,
+            sim->regs[RFM69_REG_0E_LISTEN2]);
+    sim->listen_rx_ns = _sim_listen_ns(l1 >> 4,
+            sim->regs[RFM69_REG_0F_LISTEN3]);
+    _sim_check_pa(sim);
+}
+
+/**
+ * Check whether Listen mode hears a frame. With the RSSI criterion, the
+ * receiver stays on if an Rx period sees any of the preamble, and then finds
+ * the sync word. With RSSI and SyncAddress, the sync word must end within an
+ * Rx period.
+ */
+static bool _sim_listen_hears(const rfm69_sim_t* sim, uint64_t start_ns,
+        const uint64_t sync_ns)
+{
+    uint64_t period = sim->listen_idle_ns + sim->listen_rx_ns;
+    uint64_t phase;
+
+    if (!period)
+        return false;
+
+    if (sim->regs[RFM69_REG_0D_LISTEN1] & RF_LISTEN1_CRITERIA_RSSIANDSYNC)
+        start_ns = sync_ns;
+    if (start_ns < sim->listen_start_ns)
+        start_ns = sim->listen_start_ns;
+    if (start_ns > sync_ns)
+        return false;
+
+    /* In an Rx period, or one starts before the sync word ends */
+    phase = (start_ns - sim->listen_start_ns) % period;
+    return phase >= sim->listen_idle_ns
+        || start_ns + sim->listen_idle_ns - phase <= sync_ns;
+}
+
+/**
+ * Handle a write to RegOpMode, modelling the sequencer transition time and
+ * the FIFO clearing rules from the datasheet.
+ */
+static void _sim_set_mode(rfm69_sim_t* sim, const rfm_reg_t val)
+{
+    rfm_reg_t newMode = val & 0x1C;
+    rfm_reg_t oldMode = sim->mode;
+    uint64_t t = 0;
+
+    /* Setting ListenOn in Standby starts Listen mode, ListenAbort or
+     * clearing ListenOn stops it */
+    if (!(val & RF_OPMODE_LISTEN_ON) || (val & RF_OPMODE_LISTENABORT))
+        sim->listen = false;
+    else if (!(sim->regs[RFM69_REG_01_OPMODE] & RF_OPMODE_LISTEN_ON)
+            && newMode == RF_OPMODE_STANDBY)
+        _sim_listen_start(sim);
+
+    sim->regs[RFM69_REG_01_OPMODE] = val & ~RF_OPMODE_LISTENABORT;
+    if (newMode == oldMode)
+        return;
+
+    sim->stats.mode_changes++;
+    sim->mode = newMode;
+
+    /* Leaving Tx always clears the FIFO and PacketSent */
+    if (oldMode == RF_OPMODE_TRANSMITTER) {
+        _sim_fifo_clear(sim);
+        sim->packet_sent = false;
+        sim->tx_state = RFM69_SIM_TX_IDLE;
+    }
+
+    /* The temperature sensor only runs in Standby or FS */
+    if (newMode != RF_OPMODE_STANDBY && newMode != RF_OPMODE_SYNTHESIZER
+            && sim->now_ns < sim->temp_done_ns)
+        sim->temp_done_ns = sim->now_ns;
+
+    /* Leaving Rx abandons any frame in progress, FIFO is kept */
+    if (oldMode == RF_OPMODE_RECEIVER) {
+        sim->rx_active = false;
+        sim->sync_match = false;
+    }
+
+    /* Entering Rx clears the FIFO, as does going from Rx to Tx */
+    if (newMode == RF_OPMODE_RECEIVER
+            || (newMode == RF_OPMODE_TRANSMITTER
+                && oldMode == RF_OPMODE_RECEIVER)) {
+        _sim_fifo_clear(sim);
+        sim->payload_ready = false;
+        sim->crc_ok = false;
+        sim->fifo_overrun = false;
+    }
+    if (newMode == RF_OPMODE_RECEIVER) {
+        sim->rx_hz = rfm69_sim_frequency(sim);
+        _sim_check_pa(sim);
+    }
+
+    /* Work out when ModeReady will be asserted */
+    if (oldMode == RF_OPMODE_SLEEP)
+        t += RFM69_SIM_TS_OSC_NS;
+    if ((newMode == RF_OPMODE_SYNTHESIZER || newMode == RF_OPMODE_TRANSMITTER
+                || newMode == RF_OPMODE_RECEIVER)
+            && (oldMode == RF_OPMODE_SLEEP || oldMode == RF_OPMODE_STANDBY))
+        t += RFM69_SIM_TS_FS_NS;
+    if (newMode == RF_OPMODE_TRANSMITTER)
+        t += 1000ULL * _sim_paramp_us[sim->regs[RFM69_REG_12_PA_RAMP] & 0x0F];
+    if (newMode == RF_OPMODE_RECEIVER)
+        t += RFM69_SIM_TS_RE_NS;
+
+    sim->ready_ns = sim->now_ns + t;
+}
+
+/**
+ * Whether address filtering is on.
+ */
+static bool _sim_filtering(const rfm69_sim_t* sim)
+{
+    return sim->regs[RFM69_REG_37_PACKET_CONFIG1]
+        & RF_PACKET1_ADRSFILTERING_MASK;
+}
+
+/**
+ * Stand-in for the AES engine: with AesOn the payload octets are mixed with
+ * the key, and the same again recovers them. This is not AES, but it is
+ * enough to check that both ends must agree on the key. As on the chip, the
+ * address byte is left in the clear when address filtering is on.
+ */
+static rfm_reg_t _sim_aes(const rfm69_sim_t* sim, const rfm_reg_t b,
+        const uint8_t i)
+{
+    if (!(sim->regs[RFM69_REG_3D_PACKET_CONFIG2] & RF_PACKET2_AES_ON)
+            || (i == 0 && _sim_filtering(sim)))
+        return b;
+    return b ^ sim->regs[RFM69_REG_3E_AES_KEY1 + (i & 0x0F)];
+}
+
+/**
+ * Record a frame that has finished going on air.
+ */
+static void _sim_log_tx(rfm69_sim_t* sim)
+{
+    sim->tx_cur.end_ns = sim->tx_next_ns;
+    sim->tx_log[sim->tx_log_next] = sim->tx_cur;
+    sim->tx_log_next = (sim->tx_log_next + 1) % RFM69_SIM_TX_LOG;
+    sim->stats.frames_sent++;
+}
+
+/**
+ * Move the transmit engine forward to the current time.
+ */
+static void _sim_update_tx(rfm69_sim_t* sim)
+{
+    uint64_t byte_ns = rfm69_sim_byte_ns(sim);
+    rfm_reg_t thresh = sim->regs[RFM69_REG_3C_FIFO_THRESHOLD];
+    bool start;
+    rfm_reg_t b;
+
+    if (sim->mode != RF_OPMODE_TRANSMITTER)
+        return;
+
+    if (sim->tx_state == RFM69_SIM_TX_IDLE) {
+        if (sim->now_ns < sim->ready_ns)
+            return;
+        if (thresh & RF_FIFOTHRESH_TXSTART_FIFONOTEMPTY)
+            start = sim->fifo_count > 0;
+        else
+            start = sim->fifo_count > (thresh & 0x7F);
+        if (!start)
+            return;
+        sim->tx_state = RFM69_SIM_TX_HEADER;
+        sim->tx_cur.start_ns = sim->now_ns;
+        sim->tx_cur.len = 0;
+        sim->tx_next_ns = sim->now_ns + _sim_header_bytes(sim) * byte_ns;
+        sim->tx_total = 0;
+        sim->tx_left = 0;
+    }
+
+    while (sim->tx_next_ns <= sim->now_ns) {
+        switch (sim->tx_state) {
+            case RFM69_SIM_TX_HEADER:
+                sim->tx_state = RFM69_SIM_TX_DATA;
+                if (_sim_variable_length(sim)) {
+                    /* Length octet leaves the FIFO first */
+                    if (!sim->fifo_count)
+                        sim->stats.tx_underruns++;
+                    b = _sim_fifo_pop(sim);
+                    sim->tx_total = b;
+                    sim->tx_cur.len = b;
+                    sim->tx_next_ns += byte_ns;
+                } else {
+                    sim->tx_total = sim->regs[RFM69_REG_38_PAYLOAD_LENGTH];
+                    sim->tx_cur.len = sim->tx_total;
+                }
+                sim->tx_left = sim->tx_total;
+                break;
+            case RFM69_SIM_TX_DATA:
+                if (!sim->tx_left) {
+                    sim->tx_state = RFM69_SIM_TX_TRAILER;
+                    sim->tx_next_ns += _sim_crc_bytes(sim) * byte_ns;
+                    break;
+                }
+                if (!sim->fifo_count)
+                    sim->stats.tx_underruns++;
+                b = _sim_fifo_pop(sim);
+                sim->tx_cur.data[sim->tx_total - sim->tx_left] =
+                    _sim_aes(sim, b, sim->tx_total - sim->tx_left);
+                sim->tx_left--;
+                sim->tx_next_ns += byte_ns;
+                break;
+            case RFM69_SIM_TX_TRAILER:
+                sim->tx_state = RFM69_SIM_TX_DONE;
+                sim->packet_sent = true;
+                _sim_log_tx(sim);
+                return;
+            default:
+                return;
+        }
+    }
+}
+
+/**
+ * Remove the first frame from the air queue.
+ */
+static void _sim_air_pop(rfm69_sim_t* sim)
+{
+    memmove(&sim->air[0], &sim->air[1],
+            (sim->air_count - 1) * sizeof(sim->air[0]));
+    sim->air_count--;
+}
+
+/**
+ * Decrypt the payload octets of the frame just received that are still in
+ * the FIFO, which the chip does before raising PayloadReady.
+ */
+static void _sim_fifo_decrypt(rfm69_sim_t* sim)
+{
+    uint8_t n, i, pos;
+
+    n = sim->fifo_count < sim->rx_cur.len ? sim->fifo_count : sim->rx_cur.len;
+    for (i = 0; i < n; i++) {
+        pos = (sim->fifo_head + sim->fifo_count - n + i) % RFM69_SIM_FIFO_SIZE;
+        sim->fifo[pos] = _sim_aes(sim, sim->fifo[pos],
+                sim->rx_cur.len - n + i);
+    }
+}
+
+/**
+ * Measure the carrier offset of the frame being received into FeiValue and,
+ * with AfcAutoOn, correct for it in AfcValue. Both are in Fstep units.
+ */
+static void _sim_afc(rfm69_sim_t* sim)
+{
+    int32_t v;
+
+    /* Fstep is FXOSC / 2^19, i.e. 15625 / 256 Hz */
+    v = sim->rx_cur.offset_hz * 256;
+    v = (v + (v < 0 ? -15625 / 2 : 15625 / 2)) / 15625;
+    sim->regs[RFM69_REG_21_FEI_MSB] = (uint16_t)v >> 8;
+    sim->regs[RFM69_REG_22_FEI_LSB] = (uint16_t)v & 0xFF;
+    if (sim->regs[RFM69_REG_1E_AFC_FEI] & RF_AFCFEI_AFCAUTO_ON) {
+        sim->regs[RFM69_REG_1F_AFC_MSB] = (uint16_t)v >> 8;
+        sim->regs[RFM69_REG_20_AFC_LSB] = (uint16_t)v & 0xFF;
+    }
+}
+
+/**
+ * Move the receive engine forward to the current time.
+ */
+static void _sim_update_rx(rfm69_sim_t* sim)
+{
+    uint64_t byte_ns = rfm69_sim_byte_ns(sim);
+    uint16_t hdr = _sim_header_bytes(sim);
+    uint8_t crc = _sim_crc_bytes(sim);
+    uint64_t sync_ns;
+    bool listen_rx;
+    rfm_reg_t b;
+
+    /* The RSSI is held from the sync word until the payload is collected */
+    if (sim->mode == RF_OPMODE_RECEIVER && !sim->payload_ready)
+        sim->rssi_dbm = _sim_rssi_now(sim);
+
+    for (;;) {
+        /* Push any octets of the current frame that have arrived */
+        while (sim->rx_active && sim->rx_pushed < sim->rx_total
+                && sim->rx_sync_ns + (sim->rx_pushed + 1) * byte_ns
+                    <= sim->now_ns) {
+            if (sim->rx_pushed == 0)
+                b = sim->rx_cur.len;
+            else
+                b = sim->rx_cur.data[sim->rx_pushed - 1];
+
+            /* Frames longer than PayloadLength are dropped by the chip */
+            if (sim->rx_pushed == 0 && _sim_variable_length(sim)
+                    && b > sim->regs[RFM69_REG_38_PAYLOAD_LENGTH]) {
+                sim->rx_active = false;
+                sim->sync_match = false;
+                sim->stats.frames_missed++;
+                break;
+            }
+
+            /* With address filtering, a frame for another node is dropped
+             * as soon as its address byte arrives */
+            if (sim->rx_pushed == 1 && _sim_filtering(sim)
+                    && b != sim->regs[RFM69_REG_39_NODE_ADRS]
+                    && ((sim->regs[RFM69_REG_37_PACKET_CONFIG1]
+                            & RF_PACKET1_ADRSFILTERING_MASK)
+                        != RF_PACKET1_ADRSFILTERING_NODEBROADCAST
+                        || b != sim->regs[RFM69_REG_3A_BROADCAST_ADRS])) {
+                _sim_fifo_clear(sim);
+                sim->rx_active = false;
+                sim->sync_match = false;
+                sim->stats.frames_filtered++;
+                break;
+            }
+            _sim_fifo_push(sim, b);
+            sim->rx_pushed++;
+        }
+
+        /* After the CRC, PayloadReady is raised. Listen mode (with
+         * ListenEnd 01) then stops, in the mode given in RegOpMode. */
+        if (sim->rx_active && sim->rx_pushed == sim->rx_total
+                && sim->rx_sync_ns + (sim->rx_total + crc) * byte_ns
+                    <= sim->now_ns) {
+            _sim_fifo_decrypt(sim);
+            sim->rx_active = false;
+            sim->payload_ready = true;
+            sim->crc_ok = true;
+            sim->listen = false;
+            sim->stats.frames_received++;
+        }
+
+        if (!sim->air_count)
+            return;
+
+        sync_ns = sim->air[0].start_ns + hdr * byte_ns;
+        if (sync_ns > sim->now_ns)
+            return;
+
+        /* Listen mode wakes the receiver up, which clears the FIFO */
+        if (sim->listen && !sim->rx_active
+                && _sim_on_channel(sim, &sim->air[0])
+                && _sim_listen_hears(sim, sim->air[0].start_ns, sync_ns)) {
+            _sim_fifo_clear(sim);
+            sim->payload_ready = false;
+            sim->crc_ok = false;
+            listen_rx = true;
+        } else {
+            listen_rx = false;
+        }
+
+        /* The receiver must have been ready for at least an octet of
+         * preamble before the sync word ends to lock on */
+        if ((listen_rx || (sim->mode == RF_OPMODE_RECEIVER
+                        && sim->ready_ns + byte_ns <= sync_ns))
+                && !sim->rx_active && !sim->payload_ready
+                && _sim_on_channel(sim, &sim->air[0])) {
+            sim->rx_cur = sim->air[0];
+            sim->rx_active = true;
+            sim->rx_sync_ns = sync_ns;
+            sim->rx_pushed = 0;
+            sim->rx_total = (_sim_variable_length(sim) ? 1 : 0)
+                + sim->rx_cur.len;
+            if (!_sim_variable_length(sim)) {
+                sim->rx_total = sim->regs[RFM69_REG_38_PAYLOAD_LENGTH];
+                /* Fixed length mode has no length octet */
+                sim->rx_pushed = 1;
+                sim->rx_total++;
+            }
+            sim->sync_match = true;
+            sim->rssi_dbm = sim->rx_cur.rssi;
+            _sim_afc(sim);
+        } else {
+            sim->stats.frames_missed++;
+        }
+        _sim_air_pop(sim);
+    }
+}
+
+/**
+ * Bring all time-dependent state up to date.
+ */
+static void _sim_update(rfm69_sim_t* sim)
+{
+    _sim_update_tx(sim);
+    _sim_update_rx(sim);
+}
+
+/**
+ * Advance simulated time, stepping the radio at bit granularity so that no
+ * event is skipped over.
+ * @param sim The emulated radio
+ * @param ns The number of nanoseconds to advance by
+ */
+void rfm69_sim_advance(rfm69_sim_t* sim, const uint64_t ns)
+{
+    uint64_t step = rfm69_sim_byte_ns(sim) / 8;
+    uint64_t left = ns;
+
+    if (!step)
+        step = 1;
+
+    while (left) {
+        uint64_t d = left < step ? left : step;
+        sim->now_ns += d;
+        left -= d;
+        _sim_update(sim);
+    }
+}
+
+/**
+ * Compute RegIrqFlags1 from the current state.
+ */
+static rfm_reg_t _sim_irq_flags1(const rfm69_sim_t* sim)
+{
+    rfm_reg_t f = 0;
+    bool ready = sim->now_ns >= sim->ready_ns;
+
+    if (ready)
+        f |= RF_IRQFLAGS1_MODEREADY;
+    if (ready && sim->mode == RF_OPMODE_RECEIVER)
+        f |= RF_IRQFLAGS1_RXREADY;
+    if (ready && sim->mode == RF_OPMODE_TRANSMITTER)
+        f |= RF_IRQFLAGS1_TXREADY;
+    if (ready && sim->now_ns >= sim->pll_lock_ns
+            && (sim->mode == RF_OPMODE_SYNTHESIZER
+                || sim->mode == RF_OPMODE_RECEIVER
+                || sim->mode == RF_OPMODE_TRANSMITTER))
+        f |= RF_IRQFLAGS1_PLLLOCK;
+    if (sim->sync_match)
+        f |= RF_IRQFLAGS1_SYNCADDRESSMATCH;
+    return f;
+}
+
+/**
+ * Compute RegIrqFlags2 from the current state.
+ */
+static rfm_reg_t _sim_irq_flags2(const rfm69_sim_t* sim)
+{
+    rfm_reg_t f = 0;
+
+    if (sim->fifo_count == RFM69_SIM_FIFO_SIZE)
+        f |= RF_IRQFLAGS2_FIFOFULL;
+    if (sim->fifo_count)
+        f |= RF_IRQFLAGS2_FIFONOTEMPTY;
+    if (sim->fifo_count > (sim->regs[RFM69_REG_3C_FIFO_THRESHOLD] & 0x7F))
+        f |= RF_IRQFLAGS2_FIFOLEVEL;
+    if (sim->fifo_overrun)
+        f |= RF_IRQFLAGS2_FIFOOVERRUN;
+    if (sim->packet_sent)
+        f |= RF_IRQFLAGS2_PACKETSENT;
+    if (sim->payload_ready)
+        f |= RF_IRQFLAGS2_PAYLOADREADY;
+    if (sim->crc_ok)
+        f |= RF_IRQFLAGS2_CRCOK;
+    return f;
+}
+
+/**
+ * Handle a register read, including side effects.
+ */
+static rfm_reg_t _sim_reg_read(rfm69_sim_t* sim, const rfm_reg_t reg)
+{
+    rfm_reg_t v;
+
+    sim->stats.reg_reads++;
+
+    switch (reg) {
+        case RFM69_REG_00_FIFO:
+            sim->stats.fifo_reads++;
+            v = _sim_fifo_pop(sim);
+            if (!sim->fifo_count) {
+                /* PayloadReady and CrcOk clear when the FIFO empties */
+                sim->payload_ready = false;
+                sim->crc_ok = false;
+                sim->sync_match = false;
+            }
+            return v;
+        case RFM69_REG_0A_OSC1:
+            v = sim->regs[reg] & ~RF_OSC1_RCCAL_DONE;
+            if (sim->now_ns >= sim->rccal_done_ns)
+                v |= RF_OSC1_RCCAL_DONE;
+            return v;
+        case RFM69_REG_23_RSSI_CONFIG:
+            v = sim->regs[reg] & RF_RSSI_FASTRX_ON;
+            if (sim->now_ns >= sim->rssi_done_ns)
+                v |= RF_RSSI_DONE;
+            return v;
+        case RFM69_REG_24_RSSI_VALUE:
+            return (rfm_reg_t)(-2 * sim->rssi_dbm);
+        case RFM69_REG_27_IRQ_FLAGS1:
+            return _sim_irq_flags1(sim);
+        case RFM69_REG_28_IRQ_FLAGS2:
+            return _sim_irq_flags2(sim);
+        case RFM69_REG_4E_TEMP1:
+            v = sim->regs[reg] & RF_TEMP1_ADCLOWPOWER_ON;
+            if (sim->now_ns < sim->temp_done_ns)
+                v |= RF_TEMP1_MEAS_RUNNING;
+            return v;
+        case RFM69_REG_4F_TEMP2:
+            return (rfm_reg_t)(161 - sim->temp_c);
+        default:
+            return sim->regs[reg];
+    }
+}
+
+/**
+ * Handle a register write, including side effects.
+ */
+static void _sim_reg_write(rfm69_sim_t* sim, const rfm_reg_t reg,
+        const rfm_reg_t val)
+{
+    sim->stats.reg_writes++;
+
+    switch (reg) {
+        case RFM69_REG_00_FIFO:
+            sim->stats.fifo_writes++;
+            _sim_fifo_push(sim, val);
+            break;
+        case RFM69_REG_01_OPMODE:
+            _sim_set_mode(sim, val);
+            break;
+        case RFM69_REG_10_VERSION:
+        case RFM69_REG_24_RSSI_VALUE:
+        case RFM69_REG_27_IRQ_FLAGS1:
+        case RFM69_REG_4F_TEMP2:
+            /* Read only */
+            break;
+        case RFM69_REG_0A_OSC1:
+            /* Calibration only runs in Standby */
+            if ((val & RF_OSC1_RCCAL_START)
+                    && sim->mode == RF_OPMODE_STANDBY
+                    && sim->now_ns >= sim->rccal_done_ns)
+                sim->rccal_done_ns = sim->now_ns + RFM69_SIM_RCCAL_NS;
+            break;
+        case RFM69_REG_09_FRF_LSB:
+            /* The PLL relocks once the LSB is written. In Rx, PllLock
+             * stays set from the old channel and the receiver stays there
+             * until it is restarted. */
+            sim->regs[reg] = val;
+            if (sim->mode != RF_OPMODE_RECEIVER)
+                sim->pll_lock_ns = sim->now_ns + RFM69_SIM_TS_HOP_NS;
+            break;
+        case RFM69_REG_5A_TEST_PA1:
+        case RFM69_REG_5C_TEST_PA2:
+            sim->regs[reg] = val;
+            if (sim->mode == RF_OPMODE_RECEIVER || sim->listen)
+                _sim_check_pa(sim);
+            break;
+        case RFM69_REG_23_RSSI_CONFIG:
+            sim->regs[reg] = val & RF_RSSI_FASTRX_ON;
+            /* A sample taken while the PLL relocks only starts once it
+             * has locked */
+            if (val & RF_RSSI_START)
+                sim->rssi_done_ns = (sim->now_ns > sim->pll_lock_ns
+                        ? sim->now_ns : sim->pll_lock_ns) + RFM69_SIM_RSSI_NS;
+            break;
+        case RFM69_REG_28_IRQ_FLAGS2:
+            /* FifoOverrun is cleared by writing a one, which also
+             * empties the FIFO */
+            if (val & RF_IRQFLAGS2_FIFOOVERRUN) {
+                sim->fifo_overrun = false;
+                _sim_fifo_clear(sim);
+            }
+            break;
+        case RFM69_REG_3D_PACKET_CONFIG2:
+            sim->regs[reg] = val & ~RF_PACKET2_RXRESTART;
+            if ((val & RF_PACKET2_RXRESTART)
+                    && sim->mode == RF_OPMODE_RECEIVER) {
+                _sim_fifo_clear(sim);
+                sim->rx_active = false;
+                sim->sync_match = false;
+                sim->payload_ready = false;
+                sim->crc_ok = false;
+                sim->ready_ns = sim->now_ns + RFM69_SIM_TS_RE_NS;
+                if (sim->rx_hz != rfm69_sim_frequency(sim)) {
+                    sim->rx_hz = rfm69_sim_frequency(sim);
+                    sim->pll_lock_ns = sim->now_ns + RFM69_SIM_TS_HOP_NS;
+                }
+            }
+            break;
+        case RFM69_REG_4E_TEMP1:
+            sim->regs[reg] = val & RF_TEMP1_ADCLOWPOWER_ON;
+            /* Only runs in Standby or FS */
+            if ((val & RF_TEMP1_MEAS_START)
+                    && (sim->mode == RF_OPMODE_STANDBY
+                        || sim->mode == RF_OPMODE_SYNTHESIZER)
+                    && sim->now_ns >= sim->temp_done_ns)
+                sim->temp_done_ns = sim->now_ns + RFM69_SIM_TEMP_NS;
+            break;
+        default:
+            sim->regs[reg] = val;
+            break;
+    }
+}
+
+/**
+ * Assert the slave select line of the emulated radio.
+ * @param sim The emulated radio
+ */
+void rfm69_sim_select(rfm69_sim_t* sim)
+{
+    sim->selected = true;
+    sim->addr_phase = true;
+    sim->stats.ss_cycles++;
+}
+
+/**
+ * Deassert the slave select line of the emulated radio.
+ * @param sim The emulated radio
+ */
+void rfm69_sim_deselect(rfm69_sim_t* sim)
+{
+    sim->selected = false;
+}
+
+/**
+ * Clock one octet through the SPI interface of the emulated radio. The first
+ * octet after select is the address (with the write bit), following octets
+ * are data. The address auto-increments except when accessing the FIFO.
+ * @param sim The emulated radio
+ * @param out The octet sent by the host
+ * @returns The octet returned by the radio
+ */
+rfm_reg_t rfm69_sim_exchange(rfm69_sim_t* sim, const rfm_reg_t out)
+{
+    rfm_reg_t in = 0x00;
+
+    /* Eight SCK periods for each octet */
+    rfm69_sim_advance(sim, 8000000000ULL / sim->sck_hz);
+    sim->stats.spi_bytes++;
+
+    if (!sim->selected)
+        return 0xFF;
+
+    if (sim->addr_phase) {
+        sim->addr_phase = false;
+        sim->write = out & RFM69_SPI_WRITE_MASK;
+        sim->addr = out & ~RFM69_SPI_WRITE_MASK;
+        return in;
+    }
+
+    if (sim->write)
+        _sim_reg_write(sim, sim->addr, out);
+    else
+        in = _sim_reg_read(sim, sim->addr);
+
+    /* Writes may have started the transmitter */
+    _sim_update(sim);
+
+    if (sim->addr != RFM69_REG_00_FIFO)
+        sim->addr = (sim->addr + 1) & ~RFM69_SPI_WRITE_MASK;
+
+    return in;
+}
+
+/**
+ * Queue a frame to arrive over the air. The frame is received only if the
+ * radio is in Rx, ready and not holding a previous payload when its sync word
+ * finishes.
+ * @param sim The emulated radio
+ * @param data The payload (not including the length octet)
+ * @param len Number of octets in the payload
+ * @param rssi Signal strength of the frame in dBm
+ * @param start_ns Time at which the preamble starts
+ * @returns true if the frame was queued, false if the queue was full
+ */
+bool rfm69_sim_inject(rfm69_sim_t* sim, const uint8_t* data, uint8_t len,
+        int16_t rssi, uint64_t start_ns)
+{
+    rfm69_sim_frame_t* f;
+    uint8_t i;
+
+    if (sim->air_count == RFM69_SIM_AIR_QUEUE)
+        return false;
+
+    /* Keep the queue ordered by start time */
+    i = sim->air_count;
+    while (i && sim->air[i - 1].start_ns > start_ns) {
+        sim->air[i] = sim->air[i - 1];
+        i--;
+    }
+    f = &sim->air[i];
+    f->start_ns = start_ns;
+    f->rssi = rssi;
+    f->offset_hz = sim->offset_hz;
+    f->hz = sim->frame_hz;
+    f->len = len;
+    memcpy(f->data, data, len);
+    sim->air_count++;
+
+    return true;
+}
+
+/**
+ * Put a continuous carrier on air, e.g. another system sharing the band.
+ * @param sim The emulated radio
+ * @param hz Centre frequency of the interferer
+ * @param bw_hz Width of the band it occupies
+ * @param dbm Its signal strength at the radio
+ * @returns true if the interferer was added, false if there are too many
+ */
+bool rfm69_sim_interferer(rfm69_sim_t* sim, uint32_t hz, uint32_t bw_hz,
+        int16_t dbm)
+{
+    rfm69_sim_interferer_t* n;
+
+    if (sim->interferer_count == RFM69_SIM_INTERFERERS)
+        return false;
+
+    n = &sim->interferers[sim->interferer_count++];
+    n->hz = hz;
+    n->bw_hz = bw_hz;
+    n->dbm = dbm;
+    return true;
+}
+
+/**
+ * Get the most recent frame that the radio transmitted.
+ * @param sim The emulated radio
+ * @param frame Filled in with the frame
+ * @returns true if a frame has been transmitted, false otherwise
+ */
+bool rfm69_sim_last_tx(const rfm69_sim_t* sim, rfm69_sim_txframe_t* frame)
+{
+    if (!sim->stats.frames_sent)
+        return false;
+    *frame = sim->tx_log[(sim->tx_log_next + RFM69_SIM_TX_LOG - 1)
+        % RFM69_SIM_TX_LOG];
+    return true;
+}
+
+/**
+ * Get the level of the DIO0 pin, following the RegDioMapping1 table for the
+ * current mode.
+ * @param sim The emulated radio
+ * @returns true if DIO0 is high
+ */
+bool rfm69_sim_dio0(rfm69_sim_t* sim)
+{
+    rfm_reg_t map = sim->regs[RFM69_REG_25_DIO_MAPPING1] & 0xC0;
+
+    _sim_update(sim);
+
+    switch (sim->mode) {
+        case RF_OPMODE_RECEIVER:
+            if (map == RF_DIOMAPPING1_DIO0_00)
+                return sim->crc_ok;
+            if (map == RF_DIOMAPPING1_DIO0_01)
+                return sim->payload_ready;
+            if (map == RF_DIOMAPPING1_DIO0_10)
+                return sim->sync_match;
+            return false;
+        case RF_OPMODE_TRANSMITTER:
+            if (map == RF_DIOMAPPING1_DIO0_00)
+                return sim->packet_sent;
+            if (map == RF_DIOMAPPING1_DIO0_01)
+                return sim->now_ns >= sim->ready_ns;
+            return false;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,227 @@
+/**
+ * rfm69_sim.h
+ *
+ * This file is part of the UKHASNet (ukhas.net) maintained RFM69 library for
+ * use with all UKHASnet nodes, including Arduino, AVR and ARM.
+ *
+ * A software model of the RFM69 register file, FIFO, interrupt flags, mode
+ * sequencer and on-air timing. It sits behind the spi_conf interface so that
+ * the library can be exercised on a host machine with no radio attached.
+ */
+
+#ifndef __RFM69_SIM_H__
+#define __RFM69_SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ukhasnet-rfm69.h"
+
+/* Number of addressable registers (7 bit address space) */
+#define RFM69_SIM_NUM_REGS      0x80
+
+/* The RFM69 FIFO is 66 bytes deep, not the 64 usable for a payload */
+#define RFM69_SIM_FIFO_SIZE     66
+
+/* Value returned by RegVersion */
+#define RFM69_SIM_VERSION       0x24
+
+/* Crystal frequency, used to derive bitrate and PLL step */
+#define RFM69_SIM_FXOSC         32000000UL
+
+/* Default SCK rate: 8MHz AVR with SPI2X set */
+#define RFM69_SIM_DEFAULT_SCK   4000000UL
+
+/* Depth of the queue of packets waiting to go on air towards the radio */
+#define RFM69_SIM_AIR_QUEUE     8
+
+/* Packets transmitted by the radio that are kept for inspection */
+#define RFM69_SIM_TX_LOG        4
+
+/* Largest frame the model will carry (length byte is one octet) */
+#define RFM69_SIM_MAX_FRAME     255
+
+/* Noise floor reported by the RSSI block when nothing is on air */
+#define RFM69_SIM_NOISE_DBM     (-110)
+
+/* Modelled time for a temperature conversion and an RSSI sample */
+#define RFM69_SIM_TEMP_NS       100000ULL
+#define RFM69_SIM_RSSI_NS       32000ULL
+
+/* Modelled time for an RC oscillator calibration (not in the datasheet) */
+#define RFM69_SIM_RCCAL_NS      1000000ULL
+
+/* Modelled mode transition times (see datasheet table 5) */
+#define RFM69_SIM_TS_OSC_NS     1000000ULL
+#define RFM69_SIM_TS_FS_NS      60000ULL
+#define RFM69_SIM_TS_RE_NS      40000ULL
+
+/* Modelled PLL relock time after the carrier is retuned (TS_HOP) */
+#define RFM69_SIM_TS_HOP_NS     20000ULL
+
+/* Host time charged for reading the millisecond tick, so that a loop that
+ * only watches the clock still sees it move */
+#define RFM69_SIM_MILLIS_NS     1000ULL
+
+/* Number of interferers that can be placed around the band */
+#define RFM69_SIM_INTERFERERS   4
+
+/**
+ * A continuous carrier on some channel, heard whenever the radio is tuned
+ * within bw_hz / 2 of it.
+ */
+typedef struct rfm69_sim_interferer_t {
+    uint32_t hz;
+    uint32_t bw_hz;
+    int16_t dbm;
+} rfm69_sim_interferer_t;
+
+/**
+ * A frame travelling over the air towards the emulated radio.
+ */
+typedef struct rfm69_sim_frame_t {
+    uint64_t start_ns;
+    int16_t rssi;
+    int32_t offset_hz;
+    uint32_t hz;
+    uint8_t len;
+    uint8_t data[RFM69_SIM_MAX_FRAME];
+} rfm69_sim_frame_t;
+
+/**
+ * A frame that the emulated radio put on air.
+ */
+typedef struct rfm69_sim_txframe_t {
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint8_t len;
+    uint8_t data[RFM69_SIM_MAX_FRAME];
+} rfm69_sim_txframe_t;
+
+/**
+ * Counters maintained by the model, useful for benchmarks and assertions.
+ */
+typedef struct rfm69_sim_stats_t {
+    uint32_t spi_calls;
+    uint32_t ss_cycles;
+    uint32_t spi_bytes;
+    uint32_t reg_reads;
+    uint32_t reg_writes;
+    uint32_t fifo_reads;
+    uint32_t fifo_writes;
+    uint32_t fifo_underflows;
+    uint32_t fifo_overruns;
+    uint32_t tx_underruns;
+    uint32_t mode_changes;
+    uint32_t frames_sent;
+    uint32_t frames_received;
+    uint32_t frames_missed;
+    uint32_t frames_filtered;
+    uint32_t pa_boost_rx;
+} rfm69_sim_stats_t;
+
+/* State of the transmit engine */
+typedef enum rfm69_sim_tx_state_t {
+    RFM69_SIM_TX_IDLE,
+    RFM69_SIM_TX_HEADER,
+    RFM69_SIM_TX_DATA,
+    RFM69_SIM_TX_TRAILER,
+    RFM69_SIM_TX_DONE
+} rfm69_sim_tx_state_t;
+
+/**
+ * Complete state of one emulated RFM69.
+ */
+typedef struct rfm69_sim_t {
+    /* Register file and FIFO */
+    rfm_reg_t regs[RFM69_SIM_NUM_REGS];
+    rfm_reg_t fifo[RFM69_SIM_FIFO_SIZE];
+    uint8_t fifo_head;
+    uint8_t fifo_count;
+
+    /* Simulated time and bus speed */
+    uint64_t now_ns;
+    uint32_t sck_hz;
+
+    /* SPI transaction state */
+    bool selected;
+    bool addr_phase;
+    bool write;
+    rfm_reg_t addr;
+
+    /* Sequencer, and the channel the receiver settled on when it was last
+     * started */
+    rfm_reg_t mode;
+    uint64_t ready_ns;
+    uint64_t pll_lock_ns;
+    uint32_t rx_hz;
+
+    /* Interrupt sources not derived from the FIFO */
+    bool fifo_overrun;
+    bool packet_sent;
+    bool payload_ready;
+    bool crc_ok;
+    bool sync_match;
+
+    /* Transmit engine */
+    rfm69_sim_tx_state_t tx_state;
+    uint64_t tx_next_ns;
+    uint16_t tx_left;
+    uint16_t tx_total;
+    rfm69_sim_txframe_t tx_cur;
+
+    /* Receive engine */
+    rfm69_sim_frame_t air[RFM69_SIM_AIR_QUEUE];
+    uint8_t air_count;
+    bool rx_active;
+    uint64_t rx_sync_ns;
+    uint16_t rx_pushed;
+    uint16_t rx_total;
+    rfm69_sim_frame_t rx_cur;
+
+    /* Listen mode: when it was entered and the idle and Rx periods */
+    bool listen;
+    uint64_t listen_start_ns;
+    uint64_t listen_idle_ns;
+    uint64_t listen_rx_ns;
+
+    /* RC oscillator, temperature and RSSI measurement blocks */
+    uint64_t rccal_done_ns;
+    int8_t temp_c;
+    uint64_t temp_done_ns;
+    uint64_t rssi_done_ns;
+    int16_t noise_dbm;
+    int16_t rssi_dbm;
+
+    /* Carrier offset of the frames injected from now on, in Hz, and the
+     * channel they are sent on (0 for frames heard on any channel) */
+    int32_t offset_hz;
+    uint32_t frame_hz;
+
+    /* Other users of the band */
+    rfm69_sim_interferer_t interferers[RFM69_SIM_INTERFERERS];
+    uint8_t interferer_count;
+
+    /* Log of transmitted frames */
+    rfm69_sim_txframe_t tx_log[RFM69_SIM_TX_LOG];
+    uint8_t tx_log_next;
+
+    rfm69_sim_stats_t stats;
+} rfm69_sim_t;
+
+void rfm69_sim_init(rfm69_sim_t* sim);
+void rfm69_sim_select(rfm69_sim_t* sim);
+void rfm69_sim_deselect(rfm69_sim_t* sim);
+rfm_reg_t rfm69_sim_exchange(rfm69_sim_t* sim, const rfm_reg_t out);
+void rfm69_sim_advance(rfm69_sim_t* sim, const uint64_t ns);
+uint64_t rfm69_sim_byte_ns(const rfm69_sim_t* sim);
+uint32_t rfm69_sim_bitrate(const rfm69_sim_t* sim);
+uint32_t rfm69_sim_frequency(const rfm69_sim_t* sim);
+bool rfm69_sim_interferer(rfm69_sim_t* sim, uint32_t hz, uint32_t bw_hz,
+        int16_t dbm);
+bool rfm69_sim_inject(rfm69_sim_t* sim, const uint8_t* data, uint8_t len,
+        int16_t rssi, uint64_t start_ns);
+bool rfm69_sim_dio0(rfm69_sim_t* sim);
+bool rfm69_sim_last_tx(const rfm69_sim_t* sim, rfm69_sim_txframe_t* frame);
+
+#endif /* __RFM69_SIM_H__ */
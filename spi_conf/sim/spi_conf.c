@@ -0,0 +1,173 @@
+/**
+ * spi_conf.c
+ *
+ * This file is part of the UKHASNet (ukhas.net) maintained RFM69 library for
+ * use with all UKHASnet nodes, including Arduino, AVR and ARM.
+ *
+ * SPI driver for the software RFM69 emulator. Each call is forwarded to the
+ * model in rfm69_sim.c, which charges simulated bus time at its SCK rate.
+ */
+
+#include <stddef.h>
+
+#include "ukhasnet-rfm69.h"
+#include "spi_conf.h"
+
+/** The emulated radio */
+rfm69_sim_t rfm69_sim;
+
+/**
+ * User SPI setup function. Powers up the emulated radio unless the caller has
+ * already done so (e.g. to queue frames or change the SCK rate).
+ * @returns RFM_OK on success, RFM_FAIL or RFM_TIMEOUT on failure
+ */
+rfm_status_t spi_init(void)
+{
+    if (!rfm69_sim.sck_hz)
+        rfm69_sim_init(&rfm69_sim);
+    return RFM_OK;
+}
+
+/**
+ * User function to exchange a single byte over the SPI interface
+ * @warn This does not handle SS, since higher level functions might want to do
+ * burst read and writes
+ * @param out The byte to be sent
+ * @param in A pointer into which we place the returned value
+ * @returns RFM_OK on success, RFM_FAIL or RFM_TIMEOUT on failure
+ */
+rfm_status_t spi_exchange_single(const rfm_reg_t out, rfm_reg_t* in)
+{
+    rfm69_sim.stats.spi_calls++;
+    *in = rfm69_sim_exchange(&rfm69_sim, out);
+    return RFM_OK;
+}
+
+/**
+ * User function to exchange a block of bytes over the SPI interface
+ * @warn This does not handle SS
+ * @param out The bytes to be sent, or NULL to send 0xFF
+ * @param in Where to put the received bytes, or NULL to discard them
+ * @param len The number of bytes to exchange
+ * @returns RFM_OK on success, RFM_FAIL or RFM_TIMEOUT on failure
+ */
+rfm_status_t spi_exchange_burst(const rfm_reg_t* out, rfm_reg_t* in,
+        uint8_t len)
+{
+    rfm_reg_t b;
+
+    rfm69_sim.stats.spi_calls++;
+    while (len--) {
+        b = rfm69_sim_exchange(&rfm69_sim, out ? *out++ : 0xFF);
+        if (in)
+            *in++ = b;
+    }
+    return RFM_OK;
+}
+
+/**
+ * User function to assert the slave select pin
+ * @returns RFM_OK on success, RFM_FAIL or RFM_TIMEOUT on failure
+ */
+rfm_status_t spi_ss_assert(void)
+{
+    rfm69_sim_select(&rfm69_sim);
+    return RFM_OK;
+}
+
+/**
+ * User function to deassert the slave select pin
+ * @returns RFM_OK on success, RFM_FAIL or RFM_TIMEOUT on failure
+ */
+rfm_status_t spi_ss_deassert(void)
+{
+    rfm69_sim_deselect(&rfm69_sim);
+    return RFM_OK;
+}
+
+/**
+ * User function returning a free running millisecond count. This is the
+ * simulated time, which moves on with every bus transaction and every read
+ * of the count, so a radio that never answers still runs into the library's
+ * deadlines and a backoff that leaves the bus alone still ends.
+ * @returns The number of simulated milliseconds since power up
+ */
+uint32_t spi_millis(void)
+{
+    rfm69_sim_advance(&rfm69_sim, RFM69_SIM_MILLIS_NS);
+    return rfm69_sim.now_ns / 1000000ULL;
+}
+
+/*
+ * The same driver for any number of emulated radios, through rf69_dev_t.
+ * The ctx is the rfm69_sim_t, which is powered up by init if need be.
+ */
+
+static rfm_status_t _sim_ops_init(void* ctx)
+{
+    rfm69_sim_t* sim = ctx;
+
+    if (!sim->sck_hz)
+        rfm69_sim_init(sim);
+    return RFM_OK;
+}
+
+static rfm_status_t _sim_ops_exchange_single(void* ctx, const rfm_reg_t out,
+        rfm_reg_t* in)
+{
+    rfm69_sim_t* sim = ctx;
+
+    sim->stats.spi_calls++;
+    *in = rfm69_sim_exchange(sim, out);
+    return RFM_OK;
+}
+
+#ifdef SPI_HAVE_EXCHANGE_BURST
+static rfm_status_t _sim_ops_exchange_burst(void* ctx, const rfm_reg_t* out,
+        rfm_reg_t* in, uint8_t len)
+{
+    rfm69_sim_t* sim = ctx;
+    rfm_reg_t b;
+
+    sim->stats.spi_calls++;
+    while (len--) {
+        b = rfm69_sim_exchange(sim, out ? *out++ : 0xFF);
+        if (in)
+            *in++ = b;
+    }
+    return RFM_OK;
+}
+#endif
+
+static rfm_status_t _sim_ops_ss_assert(void* ctx)
+{
+    rfm69_sim_select(ctx);
+    return RFM_OK;
+}
+
+static rfm_status_t _sim_ops_ss_deassert(void* ctx)
+{
+    rfm69_sim_deselect(ctx);
+    return RFM_OK;
+}
+
+static uint32_t _sim_ops_millis(void* ctx)
+{
+    rfm69_sim_t* sim = ctx;
+
+    rfm69_sim_advance(sim, RFM69_SIM_MILLIS_NS);
+    return sim->now_ns / 1000000ULL;
+}
+
+const rf69_spi_ops_t spi_sim_ops = {
+    _sim_ops_init,
+    _sim_ops_exchange_single,
+#ifdef SPI_HAVE_EXCHANGE_BURST
+    _sim_ops_exchange_burst,
+#else
+    NULL,
+#endif
+    _sim_ops_ss_assert,
+    _sim_ops_ss_deassert,
+    _sim_ops_millis
+};
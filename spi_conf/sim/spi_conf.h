@@ -0,0 +1,30 @@
+/**
+ * spi_conf.h
+ *
+ * This file is part of the UKHASNet (ukhas.net) maintained RFM69 library for
+ * use with all UKHASnet nodes, including Arduino, AVR and ARM.
+ *
+ * SPI driver for the software RFM69 emulator, allowing the library to be
+ * built and exercised on a host machine.
+ */
+
+#ifndef __SPI_CONF_H__
+#define __SPI_CONF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rfm69_sim.h"
+
+/* Bulk transfers are used unless the build asks for the per-byte path */
+#ifndef SPI_SIM_NO_BURST
+#define SPI_HAVE_EXCHANGE_BURST
+#endif
+
+/* The emulated radio that sits on the other end of the bus */
+extern rfm69_sim_t rfm69_sim;
+
+/* Driver for further emulated radios, pass the rfm69_sim_t as ctx */
+extern const rf69_spi_ops_t spi_sim_ops;
+
+#endif /* __SPI_CONF_H__ */
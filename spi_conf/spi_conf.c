@@ -55,6 +55,31 @@ rfm_status_t spi_exchange_single(const rfm_reg_t out, rfm_reg_t* in)
     return RFM_OK;
 }
 
+#ifdef SPI_HAVE_EXCHANGE_BURST
+/**
+ * Optional user function to exchange a block of bytes over the SPI interface,
+ * e.g. using DMA. Only used if SPI_HAVE_EXCHANGE_BURST is defined in
+ * spi_conf.h, otherwise the library calls spi_exchange_single() per byte.
+ * @warn This does not handle SS
+ * @param out The bytes to be sent, or NULL to send 0xFF
+ * @param in A buffer into which we place the returned bytes, or NULL if they
+ * are not wanted
+ * @param len The number of bytes to exchange
+ * @returns RFM_OK on success, RFM_FAIL or RFM_TIMEOUT on failure
+ */
+rfm_status_t spi_exchange_burst(const rfm_reg_t* out, rfm_reg_t* in,
+        uint8_t len)
+{
+    /* Insert code to send and receive len bytes at the same time */
+
+    /*
+     * You should return RFM_OK if everything went well, otherwise return
+     * RFM_FAIL or RFM_TIMEOUT to signal that something went wrong.
+     * */
+    return RFM_OK;
+}
+#endif
+
 /**
  * User function to assert the slave select pin
  * @returns RFM_OK on success, RFM_FAIL or RFM_TIMEOUT on failure
@@ -85,3 +110,15 @@ rfm_status_t spi_ss_deassert(void)
     return RFM_OK;
 }
 
+/**
+ * User function returning a free running millisecond count, used to give up
+ * on the radio with RFM_TIMEOUT rather than waiting for it forever. It only
+ * needs to be monotonic, and may wrap.
+ * @returns The number of milliseconds since some fixed point
+ */
+uint32_t spi_millis(void)
+{
+    /* Insert code to read a millisecond tick, e.g. from a timer interrupt */
+    return 0;
+}
+
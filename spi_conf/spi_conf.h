@@ -23,4 +23,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Define this if spi_exchange_burst() is implemented in spi_conf.c */
+/* #define SPI_HAVE_EXCHANGE_BURST */
+
 #endif /* __SPI_CONF_H__ */
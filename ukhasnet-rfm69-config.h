@@ -11,20 +11,94 @@
 
 #include "ukhasnet-rfm69.h"
 
+/*
+ * Physical layer settings. CONFIG is generated from these at compile time,
+ * and any of them can be pre-defined to override the UKHASnet defaults.
+ */
+
+/* Carrier frequency in Hz */
+#ifndef RFM69_CFG_FREQUENCY
+#define RFM69_CFG_FREQUENCY     869500000UL
+#endif
+
+/* Bit rate in bps */
+#ifndef RFM69_CFG_BITRATE
+#define RFM69_CFG_BITRATE       2000UL
+#endif
+
+/* FSK frequency deviation in Hz (the shift is twice this) */
+#ifndef RFM69_CFG_FDEV
+#define RFM69_CFG_FDEV          12000UL
+#endif
+
+/* Single side receiver bandwidth in Hz, rounded up to one the chip has */
+#ifndef RFM69_CFG_RXBW
+#define RFM69_CFG_RXBW          125000UL
+#endif
+
+/* PA ramp time in us, rounded up to one the chip has */
+#ifndef RFM69_CFG_PA_RAMP_US
+#define RFM69_CFG_PA_RAMP_US    500UL
+#endif
+
+/* Bit periods to wait before restarting Rx after a packet, which must cover
+ * the transmitter's PA ramp down. Rounded up to a power of two. */
+#ifndef RFM69_CFG_RX_RESTART_BITS
+#define RFM69_CFG_RX_RESTART_BITS 2UL
+#endif
+
+/* Carrier within the 315, 433 and 868/915 MHz bands the RFM69 covers */
+RFM69_STATIC_ASSERT((RFM69_CFG_FREQUENCY >= 290000000UL
+            && RFM69_CFG_FREQUENCY <= 340000000UL)
+        || (RFM69_CFG_FREQUENCY >= 424000000UL
+            && RFM69_CFG_FREQUENCY <= 510000000UL)
+        || (RFM69_CFG_FREQUENCY >= 862000000UL
+            && RFM69_CFG_FREQUENCY <= 1020000000UL), frequency_in_band);
+
+/* FSK bit rate range */
+RFM69_STATIC_ASSERT(RFM69_CFG_BITRATE >= 1200UL
+        && RFM69_CFG_BITRATE <= 300000UL, bitrate_in_range);
+
+/* Modulation index 2 * Fdev / BR of at least 0.5, and Fdev + BR / 2 within
+ * what the modulator can do */
+RFM69_STATIC_ASSERT(4 * RFM69_CFG_FDEV >= RFM69_CFG_BITRATE,
+        modulation_index_too_low);
+RFM69_STATIC_ASSERT(RFM69_CFG_FDEV + RFM69_CFG_BITRATE / 2 <= 500000UL,
+        fdev_too_high);
+
+/* The requested bandwidth must exist, and half the Carson bandwidth
+ * (Fdev + BR / 2) must fit in the single side receiver bandwidth */
+RFM69_STATIC_ASSERT(RFM69_RXBW_HZ(RFM69_RXBW(RFM69_CFG_RXBW))
+        >= RFM69_CFG_RXBW, rxbw_out_of_range);
+RFM69_STATIC_ASSERT(RFM69_RXBW_HZ(RFM69_RXBW(RFM69_CFG_RXBW))
+        >= RFM69_CFG_FDEV + RFM69_CFG_BITRATE / 2, rxbw_narrower_than_carson);
+
+/* The Rx restart delay must outlast the PA ramp of the other end */
+RFM69_STATIC_ASSERT(RFM69_PARAMP_US(RFM69_PARAMP(RFM69_CFG_PA_RAMP_US))
+        >= RFM69_CFG_PA_RAMP_US, pa_ramp_out_of_range);
+RFM69_STATIC_ASSERT(RFM69_CFG_RX_RESTART_BITS <= 2048UL,
+        rx_restart_delay_out_of_range);
+RFM69_STATIC_ASSERT((1UL << (RFM69_RXRESTARTDELAY(RFM69_CFG_RX_RESTART_BITS)
+                >> 4)) * 1000000UL
+        >= RFM69_PARAMP_US(RFM69_PARAMP(RFM69_CFG_PA_RAMP_US))
+            * RFM69_CFG_BITRATE, rx_restart_delay_shorter_than_pa_ramp);
+
+/* Registers must stay in ascending address order, the shadow lookup is a
+ * binary search over them */
 static const rfm_reg_t CONFIG[][2] =
 {
     { RFM69_REG_01_OPMODE,      RF_OPMODE_SEQUENCER_ON | RF_OPMODE_LISTEN_OFF | RFM69_MODE_RX },
     { RFM69_REG_02_DATA_MODUL,  RF_DATAMODUL_DATAMODE_PACKET | RF_DATAMODUL_MODULATIONTYPE_FSK | RF_DATAMODUL_MODULATIONSHAPING_00 },
     
-    { RFM69_REG_03_BITRATE_MSB, 0x3E}, // 2000 bps
-    { RFM69_REG_04_BITRATE_LSB, 0x80},
+    { RFM69_REG_03_BITRATE_MSB, RFM69_BYTE(RFM69_BITRATE(RFM69_CFG_BITRATE), 1) },
+    { RFM69_REG_04_BITRATE_LSB, RFM69_BYTE(RFM69_BITRATE(RFM69_CFG_BITRATE), 0) },
     
-    { RFM69_REG_05_FDEV_MSB,    0x00}, // 12000 hz (24000 hz shift)
-    { RFM69_REG_06_FDEV_LSB,    0xC5},
+    { RFM69_REG_05_FDEV_MSB,    RFM69_BYTE(RFM69_FDEV(RFM69_CFG_FDEV), 1) },
+    { RFM69_REG_06_FDEV_LSB,    RFM69_BYTE(RFM69_FDEV(RFM69_CFG_FDEV), 0) },
 
-    { RFM69_REG_07_FRF_MSB,     0xD9 }, // 869.5 MHz
-    { RFM69_REG_08_FRF_MID,     0x60 }, // calculated: 0x80?
-    { RFM69_REG_09_FRF_LSB,     0x12 },
+    { RFM69_REG_07_FRF_MSB,     RFM69_BYTE(RFM69_FRF(RFM69_CFG_FREQUENCY), 2) },
+    { RFM69_REG_08_FRF_MID,     RFM69_BYTE(RFM69_FRF(RFM69_CFG_FREQUENCY), 1) },
+    { RFM69_REG_09_FRF_LSB,     RFM69_BYTE(RFM69_FRF(RFM69_CFG_FREQUENCY), 0) },
     
     { RFM69_REG_0B_AFC_CTRL,    RF_AFCLOWBETA_OFF }, // AFC Offset On
     
@@ -34,13 +108,13 @@ static const rfm_reg_t CONFIG[][2] =
     { RFM69_REG_11_PA_LEVEL,    RF_PALEVEL_PA0_ON | RF_PALEVEL_PA1_OFF | RF_PALEVEL_PA2_OFF | 0x1f},  // 10mW
     //{ RFM69_REG_11_PA_LEVEL, RF_PALEVEL_PA0_OFF | RF_PALEVEL_PA1_ON | RF_PALEVEL_PA2_ON | 0x1f},// 50mW
     
-    { RFM69_REG_12_PA_RAMP, RF_PARAMP_500 }, // 500us PA ramp-up (1 bit)
+    { RFM69_REG_12_PA_RAMP, RFM69_PARAMP(RFM69_CFG_PA_RAMP_US) },
     
     { RFM69_REG_13_OCP,         RF_OCP_ON | RF_OCP_TRIM_95 },
     
     { RFM69_REG_18_LNA,         RF_LNA_ZIN_50 }, // 50 ohm for matched antenna, 200 otherwise
     
-    { RFM69_REG_19_RX_BW,       RF_RXBW_DCCFREQ_010 | RF_RXBW_MANT_16 | RF_RXBW_EXP_2}, // Rx Bandwidth: 128KHz
+    { RFM69_REG_19_RX_BW,       RF_RXBW_DCCFREQ_010 | RFM69_RXBW(RFM69_CFG_RXBW) },
     
     { RFM69_REG_1E_AFC_FEI,     RF_AFCFEI_AFCAUTO_ON | RF_AFCFEI_AFCAUTOCLEAR_ON }, // Automatic AFC on, clear after each packet
     
@@ -55,9 +129,11 @@ static const rfm_reg_t CONFIG[][2] =
     { RFM69_REG_30_SYNCVALUE2, 0xAA },
     { RFM69_REG_37_PACKET_CONFIG1, RF_PACKET1_FORMAT_VARIABLE | RF_PACKET1_DCFREE_OFF | RF_PACKET1_CRC_ON | RF_PACKET1_CRCAUTOCLEAR_ON | RF_PACKET1_ADRSFILTERING_OFF },
     { RFM69_REG_38_PAYLOAD_LENGTH, RFM69_FIFO_SIZE }, // Full FIFO size for rx packet
+    { RFM69_REG_39_NODE_ADRS, RF_NODEADDRESS_VALUE }, // Only used with rf69_set_address()
+    { RFM69_REG_3A_BROADCAST_ADRS, RF_BROADCASTADDRESS_VALUE },
 //    { RFM69_REG_3B_AUTOMODES, RF_AUTOMODES_ENTER_FIFONOTEMPTY | RF_AUTOMODES_EXIT_PACKETSENT | RF_AUTOMODES_INTERMEDIATE_TRANSMITTER },
     { RFM69_REG_3C_FIFO_THRESHOLD, RF_FIFOTHRESH_TXSTART_FIFONOTEMPTY | 0x05 }, //TX on FIFO not empty
-    { RFM69_REG_3D_PACKET_CONFIG2, RF_PACKET2_RXRESTARTDELAY_2BITS | RF_PACKET2_AUTORXRESTART_ON | RF_PACKET2_AES_OFF }, //RXRESTARTDELAY must match transmitter PA ramp-down time (bitrate dependent)
+    { RFM69_REG_3D_PACKET_CONFIG2, RFM69_RXRESTARTDELAY(RFM69_CFG_RX_RESTART_BITS) | RF_PACKET2_AUTORXRESTART_ON | RF_PACKET2_AES_OFF }, //RXRESTARTDELAY must match transmitter PA ramp-down time (bitrate dependent)
     { RFM69_REG_6F_TEST_DAGC, RF_DAGC_IMPROVED_LOWBETA0 }, // run DAGC continuously in RX mode, recommended default for AfcLowBetaOn=0
 //    { RFM69_REG_71_TEST_AFC, 0x0E }, //14* 488hz = ~7KHz
     {255, 0}
@@ -0,0 +1,251 @@
+/**
+ * This file is part of the UKHASnet maintained RFM69 library.
+ *
+ * Frequency hopping on top of the driver: a channel table and a seeded hop
+ * sequence built once, a retune every dwell, and scan-and-lock for a
+ * receiver to find the transmitter's place in the sequence.
+ *
+ * Time is supplied by the caller in ms, from the same clock on every call,
+ * so that the schedule can be run from a timer interrupt or a main loop.
+ *
+ * @file ukhasnet-rfm69-hop.c
+ * @addtogroup ukhasnet-rfm69
+ * @{
+ */
+
+#include <stddef.h>
+
+#include "ukhasnet-rfm69.h"
+#include "ukhasnet-rfm69-hop.h"
+
+/** Used for a seed of 0, which xorshift can't leave */
+#define RFM69_HOP_SEED 0x2545F491UL
+
+/* Private functions */
+static uint32_t _rf69_hop_rand(uint32_t* state);
+static rfm_status_t _rf69_hop_tune(rf69_hop_t* hop);
+
+/**
+ * Set up a hop schedule for a radio: count channels spacing_hz apart from
+ * base_hz, visited in an order shuffled from seed. Both ends of a link must
+ * use the same arguments. The RegFrf bytes of every channel are worked out
+ * here so that a hop is only a register write.
+ * @param hop The schedule to set up
+ * @param dev The radio to drive, or NULL for the one used by the rf69_*
+ * functions
+ * @param base_hz Carrier frequency of channel 0 in Hz
+ * @param spacing_hz Distance between channels in Hz
+ * @param count Number of channels, up to RFM69_HOP_MAX_CHANNELS
+ * @param dwell_ms How long each channel is used for
+ * @param seed Picks the hop sequence
+ * @returns RFM_OK for success, RFM_FAIL if a channel is outside the RFM69's
+ * range or count or dwell_ms is out of range.
+ */
+rfm_status_t rf69_hop_init(rf69_hop_t* hop, rf69_dev_t* dev,
+        const uint32_t base_hz, const uint32_t spacing_hz,
+        const uint8_t count, const uint16_t dwell_ms, uint32_t seed)
+{
+    uint8_t i, j, t;
+
+    if (count == 0 || count > RFM69_HOP_MAX_CHANNELS || dwell_ms == 0)
+        return RFM_FAIL;
+
+    /* The channel plan mustn't wrap around */
+    if (base_hz + spacing_hz * (count - 1) < base_hz)
+        return RFM_FAIL;
+
+    for (i = 0; i < count; i++)
+    {
+        if (rf69_frf_bytes(base_hz + spacing_hz * i, hop->frf[i]) != RFM_OK)
+            return RFM_FAIL;
+        hop->seq[i] = i;
+    }
+
+    /* Fisher-Yates, so every channel is visited once per cycle */
+    if (seed == 0)
+        seed = RFM69_HOP_SEED;
+    for (i = count - 1; i > 0; i--)
+    {
+        j = _rf69_hop_rand(&seed) % (i + 1);
+        t = hop->seq[i];
+        hop->seq[i] = hop->seq[j];
+        hop->seq[j] = t;
+    }
+
+    hop->dev = dev ? dev : rf69_default_dev();
+    hop->count = count;
+    hop->slot = 0;
+    hop->dwell_ms = dwell_ms;
+    hop->next_ms = 0;
+    hop->scanning = false;
+    hop->scan_ms = 0;
+
+    return RFM_OK;
+}
+
+/**
+ * Start the schedule from the first channel in the sequence. A receiver is
+ * left in RX. A transmitter is parked in FS, where the synthesiser stays
+ * locked on the channel, so a send can begin without waiting for the PLL.
+ * @param hop The schedule
+ * @param now_ms The time now
+ * @param rx True for RX between hops, false for FS
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_hop_start(rf69_hop_t* hop, const uint32_t now_ms,
+        const bool rx)
+{
+    hop->slot = 0;
+    hop->next_ms = now_ms + hop->dwell_ms;
+    hop->scanning = false;
+
+    if (_rf69_hop_tune(hop) != RFM_OK)
+        return RFM_FAIL;
+
+    return rf69_dev_set_mode(hop->dev, rx ? RFM69_MODE_RX : RFM69_MODE_FS);
+}
+
+/**
+ * Move to the next channel if its dwell has started. Call this at least once
+ * per dwell; if calls were missed, any whole dwells that passed are skipped
+ * so the schedule stays in step. While scanning, the receiver moves on to
+ * another channel once it has listened to one for a whole cycle.
+ * @param hop The schedule
+ * @param now_ms The time now
+ * @returns RFM_OK for success or if a transmission is in progress, in which
+ * case the hop is left for a later call, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_hop_tick(rf69_hop_t* hop, const uint32_t now_ms)
+{
+    uint32_t n;
+
+    /* Wait for the packet to finish, the next call catches up */
+    if (hop->dev->tx_busy)
+        return RFM_OK;
+
+    if (hop->scanning)
+    {
+        /* One more dwell than a cycle, so a packet that started just before
+         * the transmitter arrived is not all that is heard */
+        if (now_ms - hop->scan_ms
+                < (uint32_t)hop->dwell_ms * (hop->count + 1))
+            return RFM_OK;
+        hop->slot = (hop->slot + 1) % hop->count;
+        hop->scan_ms = now_ms;
+        return _rf69_hop_tune(hop);
+    }
+
+    if ((int32_t)(now_ms - hop->next_ms) < 0)
+        return RFM_OK;
+
+    n = (now_ms - hop->next_ms) / hop->dwell_ms + 1;
+    hop->slot = (hop->slot + n % hop->count) % hop->count;
+    hop->next_ms += n * hop->dwell_ms;
+
+    return _rf69_hop_tune(hop);
+}
+
+/**
+ * Stop following the schedule and search for the transmitter, e.g. at power
+ * up or after no packets have been heard for a while. The receiver listens
+ * on the current channel, moving on from rf69_hop_tick() each cycle.
+ * @param hop The schedule
+ * @param now_ms The time now
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_hop_scan(rf69_hop_t* hop, const uint32_t now_ms)
+{
+    hop->scanning = true;
+    hop->scan_ms = now_ms;
+
+    if (_rf69_hop_tune(hop) != RFM_OK)
+        return RFM_FAIL;
+
+    if (hop->dev->mode != RFM69_MODE_RX)
+        return rf69_dev_set_mode(hop->dev, RFM69_MODE_RX);
+
+    return RFM_OK;
+}
+
+/**
+ * Take up the transmitter's schedule after hearing a packet on the current
+ * channel. The transmitter should send rf69_hop_elapsed() in its packets so
+ * that the receiver knows where in the dwell it is.
+ * @param hop The schedule
+ * @param now_ms The time now
+ * @param elapsed_ms How far into the dwell the transmitter was, adding the
+ * time the packet took to arrive
+ * @returns RFM_OK for success, RFM_FAIL if elapsed_ms is not within a dwell.
+ */
+rfm_status_t rf69_hop_lock(rf69_hop_t* hop, const uint32_t now_ms,
+        const uint16_t elapsed_ms)
+{
+    if (elapsed_ms >= hop->dwell_ms)
+        return RFM_FAIL;
+
+    hop->scanning = false;
+    hop->next_ms = now_ms - elapsed_ms + hop->dwell_ms;
+
+    return RFM_OK;
+}
+
+/**
+ * How far into the dwell on the current channel the schedule is.
+ * @param hop The schedule
+ * @param now_ms The time now
+ * @returns The time in ms since the last hop, 0 while scanning.
+ */
+uint16_t rf69_hop_elapsed(const rf69_hop_t* hop, const uint32_t now_ms)
+{
+    int32_t left;
+
+    if (hop->scanning)
+        return 0;
+
+    left = (int32_t)(hop->next_ms - now_ms);
+    if (left <= 0)
+        return hop->dwell_ms;
+    if (left >= hop->dwell_ms)
+        return 0;
+
+    return hop->dwell_ms - left;
+}
+
+/**
+ * The channel the schedule is on.
+ * @param hop The schedule
+ * @returns The channel number, 0 being base_hz.
+ */
+uint8_t rf69_hop_channel(const rf69_hop_t* hop)
+{
+    return hop->seq[hop->slot];
+}
+
+/**
+ * Step a xorshift32 generator.
+ * @param state Nonzero generator state, updated
+ * @returns The next value.
+ */
+static uint32_t _rf69_hop_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * Retune the radio to the current channel in the sequence.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_hop_tune(rf69_hop_t* hop)
+{
+    return rf69_dev_set_frf(hop->dev, hop->frf[hop->seq[hop->slot]]);
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,67 @@
+/**
+ * This file is part of the UKHASnet maintained RFM69 library.
+ *
+ * @file ukhasnet-rfm69-hop.h
+ * @addtogroup ukhasnet-rfm69
+ * @{
+ */
+
+#ifndef __RFM69HOP_H__
+#define __RFM69HOP_H__
+
+#include "ukhasnet-rfm69.h"
+
+/*
+ * Most channels a hop sequence can have. Each one costs 4 bytes of SRAM on
+ * AVR. Can be pre-defined to suit the band plan.
+ */
+#ifndef RFM69_HOP_MAX_CHANNELS
+#define RFM69_HOP_MAX_CHANNELS 16
+#endif
+
+/*
+ * A frequency hopping schedule driving one radio. Both ends build the same
+ * sequence from the same channel plan and seed, then move to its next channel
+ * every dwell. A receiver that has lost the schedule sits on one channel for
+ * a whole cycle with rf69_hop_scan(), which the transmitter must visit, and
+ * takes up the schedule again with rf69_hop_lock() once it hears a packet.
+ */
+typedef struct rf69_hop_t {
+    rf69_dev_t* dev;
+
+    /* RegFrf bytes of each channel, worked out once by rf69_hop_init() */
+    rfm_reg_t frf[RFM69_HOP_MAX_CHANNELS][3];
+
+    /* Channels in the order they are visited, and how many there are */
+    uint8_t seq[RFM69_HOP_MAX_CHANNELS];
+    uint8_t count;
+
+    /* Position in seq, how long each channel is used for and when the next
+     * hop is due, in ms */
+    uint8_t slot;
+    uint16_t dwell_ms;
+    uint32_t next_ms;
+
+    /* Searching for the transmitter, and when the channel being listened on
+     * was tuned */
+    bool scanning;
+    uint32_t scan_ms;
+} rf69_hop_t;
+
+rfm_status_t rf69_hop_init(rf69_hop_t* hop, rf69_dev_t* dev,
+        const uint32_t base_hz, const uint32_t spacing_hz,
+        const uint8_t count, const uint16_t dwell_ms, uint32_t seed);
+rfm_status_t rf69_hop_start(rf69_hop_t* hop, const uint32_t now_ms,
+        const bool rx);
+rfm_status_t rf69_hop_tick(rf69_hop_t* hop, const uint32_t now_ms);
+rfm_status_t rf69_hop_scan(rf69_hop_t* hop, const uint32_t now_ms);
+rfm_status_t rf69_hop_lock(rf69_hop_t* hop, const uint32_t now_ms,
+        const uint16_t elapsed_ms);
+uint16_t rf69_hop_elapsed(const rf69_hop_t* hop, const uint32_t now_ms);
+uint8_t rf69_hop_channel(const rf69_hop_t* hop);
+
+#endif /* __RFM69HOP_H__ */
+
+/**
+ * @}
+ */
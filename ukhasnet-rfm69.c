@@ -25,51 +25,310 @@
  * @{
  */
 
-#include <avr/io.h>
-#include <util/delay.h>
+#include <stddef.h>
 
 #include "ukhasnet-rfm69.h"
+#include "spi_conf.h"
 #include "ukhasnet-rfm69-config.h"
 
-/** Track the current mode of the radio */
-static rfm_reg_t _mode;
+/** Number of registers set up by CONFIG, all of which are shadowed */
+#define RFM69_CONFIG_SIZE (sizeof(CONFIG) / sizeof(CONFIG[0]) - 1)
+
+/** Fails to compile if RFM69_SHADOW_SIZE is too small for CONFIG */
+RFM69_STATIC_ASSERT(RFM69_CONFIG_SIZE <= RFM69_SHADOW_SIZE, shadow_fits);
+
+#if RFM69_RX_RING_SIZE
+/** Fails to compile unless the ring indices can wrap with a mask */
+RFM69_STATIC_ASSERT((RFM69_RX_RING_SIZE & (RFM69_RX_RING_SIZE - 1)) == 0
+        && RFM69_RX_RING_SIZE <= 128, rx_ring_pow2);
+#endif
+
+/** FXOSC / 2^11, so that Fstep is RFM69_FSTEP_DIV / 256 Hz */
+#define RFM69_FSTEP_DIV (RFM69_FXOSC >> 11)
+
+/** True for the modes in which the temperature sensor runs */
+#define RFM69_TEMP_MODE(mode) \
+    ((mode) == RFM69_MODE_STDBY || (mode) == RFM69_MODE_FS)
+
+/** The radio driven by the rf69_* functions that don't take a device */
+static rf69_dev_t _rf69_default;
 
 /* Private functions */
-static rfm_status_t _rf69_read(const rfm_reg_t reg, rfm_reg_t* result);
-static rfm_status_t _rf69_write(const rfm_reg_t reg, const rfm_reg_t val);
-static rfm_status_t _rf69_burst_read(const rfm_reg_t reg, rfm_reg_t* dest, 
-        uint8_t len);
-static rfm_status_t _rf69_fifo_write(const rfm_reg_t* src, uint8_t len);
-static rfm_status_t _rf69_clear_fifo(void);
+static rfm_status_t _rf69_select(rf69_dev_t* dev);
+static rfm_status_t _rf69_deselect(rf69_dev_t* dev);
+static rfm_status_t _rf69_transfer(rf69_dev_t* dev, const rfm_reg_t* out,
+        rfm_reg_t* in, uint8_t len);
+static uint32_t _rf69_millis(rf69_dev_t* dev);
+static bool _rf69_expired(rf69_dev_t* dev, const uint32_t deadline);
+static uint32_t _rf69_air_ms(rf69_dev_t* dev, const uint8_t len);
+static rfm_status_t _rf69_wait(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t mask, const rfm_reg_t val, const uint32_t deadline);
+static rfm_status_t _rf69_read(rf69_dev_t* dev, const rfm_reg_t reg,
+        rfm_reg_t* result);
+static rfm_status_t _rf69_write(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t val);
+static rfm_status_t _rf69_modify(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t mask, const rfm_reg_t val);
+static uint8_t _rf69_shadow_first(const rfm_reg_t reg);
+static int8_t _rf69_shadow_index(const rfm_reg_t reg);
+static rfm_reg_t _rf69_shadow_mask(const rfm_reg_t reg);
+static rfm_status_t _rf69_fifo_read(rf69_dev_t* dev, rfm_reg_t* dest,
+        rfm_reg_t* len, const uint8_t maxlen);
+static rfm_status_t _rf69_fifo_write(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* src, uint8_t len, uint8_t count);
+static rfm_status_t _rf69_fifo_append(rf69_dev_t* dev, const rfm_reg_t* src,
+        uint8_t count);
+static rfm_status_t _rf69_fifo_drain(rf69_dev_t* dev, rfm_reg_t* dest,
+        uint8_t count);
+static rfm_status_t _rf69_burst_read(rf69_dev_t* dev, const rfm_reg_t reg,
+        rfm_reg_t* dest, uint8_t len);
+static rfm_status_t _rf69_burst_write(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t* src, uint8_t len);
+static rfm_status_t _rf69_write_cached_run(rf69_dev_t* dev,
+        const rfm_reg_t reg, const rfm_reg_t* src, uint8_t len,
+        bool* changed);
+static rfm_status_t _rf69_retune(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t* src, uint8_t len);
+static rfm_status_t _rf69_rx_restart(rf69_dev_t* dev);
+static void _rf69_frf(const uint32_t hz, rfm_reg_t* frf);
+static rfm_status_t _rf69_read_cached(rf69_dev_t* dev, const rfm_reg_t reg,
+        rfm_reg_t* result);
+static rfm_status_t _rf69_tx_refill(rf69_dev_t* dev);
+static rfm_status_t _rf69_tx_finish(rf69_dev_t* dev);
+static rfm_status_t _rf69_clear_fifo(rf69_dev_t* dev);
+static rfm_status_t _rf69_rx_fifo_reset(rf69_dev_t* dev);
+static rfm_status_t _rf69_pa_setup(rf69_dev_t* dev, const uint8_t power);
+static rfm_status_t _rf69_pa_boost(rf69_dev_t* dev, const bool on);
+static rfm_status_t _rf69_temp_trigger(rf69_dev_t* dev);
+static rfm_status_t _rf69_temp_collect(rf69_dev_t* dev, bool* done);
+static void _rf69_temp_abandon(rf69_dev_t* dev);
+static rfm_status_t _rf69_set_mode(rf69_dev_t* dev, const rfm_reg_t newMode);
+static rfm_status_t _rf69_listen_time(const uint32_t us, uint8_t* resol,
+        rfm_reg_t* coef);
+static rfm_status_t _rf69_listen_resume(rf69_dev_t* dev);
+static rfm_status_t _rf69_mode_restore(rf69_dev_t* dev,
+        const rfm_reg_t oldMode, const bool listen);
+static bool _rf69_aes_on(rf69_dev_t* dev);
+static const rfm_reg_t* _rf69_tx_addr(rf69_dev_t* dev, rfm_reg_t* buf);
+static rfm_status_t _rf69_receive(rf69_dev_t* dev, rfm_reg_t* buf,
+        rfm_reg_t* len, rf69_rx_info_t* info, const bool full,
+        bool* rfm_packet_waiting);
+static rfm_status_t _rf69_rx_info(rf69_dev_t* dev, rf69_rx_info_t* info,
+        const bool full);
+static rfm_status_t _rf69_csma(rf69_dev_t* dev, const uint16_t len);
+static uint32_t _rf69_rand(rf69_dev_t* dev);
+static rfm_status_t _rf69_send(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power);
+static rfm_status_t _rf69_send_start(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power);
+static rfm_status_t _rf69_tx_load(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power);
+static rfm_status_t _rf69_tx_backoff(rf69_dev_t* dev);
+static rfm_status_t _rf69_write_cached(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t val);
 
 /**
- * Initialise the RFM69 device and set into SLEEP mode (0.1uA)
+ * Initialise an RFM69 device and set into SLEEP mode (0.1uA). All driver
+ * state lives in dev, so any number of radios can be driven side by side.
+ * @param dev The device to set up
+ * @param spi How to reach this radio, or NULL to use the functions from
+ * spi_conf.h
+ * @param ctx Passed to each of the spi functions, e.g. to pick the
+ * chip select pin
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-rfm_status_t rf69_init(void)
+rfm_status_t rf69_dev_init(rf69_dev_t* dev, const rf69_spi_ops_t* spi,
+        void* ctx)
 {
-    uint8_t i;
+    uint8_t i, n;
     rfm_reg_t res;
 
+    dev->spi = spi;
+    dev->ctx = ctx;
+    dev->listening = false;
+#if RFM69_RX_RING_SIZE
+    dev->rx_head = dev->rx_tail = 0;
+#endif
+    dev->rxs_active = false;
+    dev->tx_busy = false;
+    dev->tx_left = 0;
+    dev->tx_backoff = false;
+#if RFM69_TX_QUEUE_SIZE
+    dev->txq_count = 0;
+#endif
+    dev->temp = -127;
+    dev->temp_valid = false;
+    dev->temp_running = false;
+    dev->csma_on = false;
+    dev->csma_rand = 0x2545F491UL;
+    dev->csma_stats.clear = dev->csma_stats.busy = 0;
+    dev->csma_stats.dropped = 0;
+    dev->csma_stats.backoff_ms = 0;
+
     /* Call the user setup function to configure the SPI peripheral */
-    if (spi_init() != RFM_OK)
+    if (spi ? (spi->init && spi->init(ctx) != RFM_OK) : spi_init() != RFM_OK)
         return RFM_FAIL;
 
+    /* The first visit to STDBY or FS measures the temperature */
+    dev->temp_try_ms = _rf69_millis(dev) - RFM69_TEMP_REFRESH_MS;
+
     /* Zero version number, RFM probably not connected/functioning */
-    _rf69_read(RFM69_REG_10_VERSION, &res);
+    _rf69_read(dev, RFM69_REG_10_VERSION, &res);
     if (!res)
         return RFM_FAIL;
 
-    /* Set up device */
-    for (i = 0; CONFIG[i][0] != 255; i++)
-        _rf69_write(CONFIG[i][0], CONFIG[i][1]);
+    /* Set up device, this also fills the register shadow. Each run of
+     * consecutive addresses in CONFIG goes out as one burst, staged in the
+     * shadow since it is laid out in CONFIG order. */
+    dev->shadow_valid = false;
+    for (i = 0; CONFIG[i][0] != 255; i += n) {
+        for (n = 0; CONFIG[i + n][0] == CONFIG[i][0] + n; n++)
+            dev->shadow[i + n] = CONFIG[i + n][1];
+        _rf69_burst_write(dev, CONFIG[i][0], &dev->shadow[i], n);
+    }
+    dev->shadow_valid = true;
+
+    /* The high power registers are not in CONFIG, make sure they are off
+     * in case we are re-initialising after a high power send */
+    dev->pa_boost = true;
+    _rf69_pa_boost(dev, false);
     
     /* Set initial mode */
-    rf69_set_mode(RFM69_MODE_SLEEP);
+    _rf69_set_mode(dev, RFM69_MODE_SLEEP);
+
+    return RFM_OK;
+}
+
+/**
+ * Assert the slave select of a device
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_select(rf69_dev_t* dev)
+{
+    if (dev->spi)
+        return dev->spi->ss_assert(dev->ctx);
+    return spi_ss_assert();
+}
+
+/**
+ * Deassert the slave select of a device
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_deselect(rf69_dev_t* dev)
+{
+    if (dev->spi)
+        return dev->spi->ss_deassert(dev->ctx);
+    return spi_ss_deassert();
+}
+
+/**
+ * Clock a number of bytes through the SPI bus. Slave select must already be
+ * asserted by the caller. For a device with its own rf69_spi_ops_t the
+ * block goes to exchange_burst if it has one. Otherwise, if the user's
+ * spi_conf.h defines SPI_HAVE_EXCHANGE_BURST the whole block is handed to
+ * spi_exchange_burst() (e.g. for DMA), and failing that each byte goes
+ * through spi_exchange_single().
+ * @param out Bytes to send, or NULL to send 0xFF
+ * @param in Buffer for the received bytes, or NULL to discard them
+ * @param len The number of bytes to exchange
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_transfer(rf69_dev_t* dev, const rfm_reg_t* out,
+        rfm_reg_t* in, uint8_t len)
+{
+    rfm_reg_t dummy;
+    rfm_status_t res;
+
+#ifdef SPI_HAVE_EXCHANGE_BURST
+    if (!dev->spi)
+        return spi_exchange_burst(out, in, len);
+#endif
+    if (dev->spi && dev->spi->exchange_burst)
+        return dev->spi->exchange_burst(dev->ctx, out, in, len);
+
+    while (len--) {
+        if (dev->spi)
+            res = dev->spi->exchange_single(dev->ctx, out ? *out++ : 0xFF,
+                    in ? in++ : &dummy);
+        else
+            res = spi_exchange_single(out ? *out++ : 0xFF,
+                    in ? in++ : &dummy);
+        if (res != RFM_OK)
+            return res;
+    }
 
     return RFM_OK;
 }
 
+/**
+ * Read the millisecond tick of a device, from its own millis function if
+ * it has one and spi_millis() otherwise.
+ * @returns The current tick count, which wraps.
+ */
+static uint32_t _rf69_millis(rf69_dev_t* dev)
+{
+    if (dev->spi && dev->spi->millis)
+        return dev->spi->millis(dev->ctx);
+    return spi_millis();
+}
+
+/**
+ * Check whether a deadline from the millisecond tick has passed. Correct
+ * across the tick wrapping, as long as the deadline is less than 2^31 ms
+ * away.
+ * @param deadline The tick count at which to give up
+ * @returns True if the deadline has passed, false otherwise.
+ */
+static bool _rf69_expired(rf69_dev_t* dev, const uint32_t deadline)
+{
+    return (int32_t)(_rf69_millis(dev) - deadline) >= 0;
+}
+
+/**
+ * Work out how long a packet spends on air at the programmed bit rate,
+ * counting 3 octets of preamble, 2 of sync word, the length octet and the
+ * CRC.
+ * @param len The number of bytes in the data packet
+ * @returns The air time in ms, rounded up.
+ */
+static uint32_t _rf69_air_ms(rf69_dev_t* dev, const uint8_t len)
+{
+    rfm_reg_t br[2];
+    uint32_t bits;
+
+    _rf69_read_cached(dev, RFM69_REG_03_BITRATE_MSB, &br[0]);
+    _rf69_read_cached(dev, RFM69_REG_04_BITRATE_LSB, &br[1]);
+    bits = (len + 8UL) * 8;
+
+    /* bits / (FXOSC / BitRate) seconds, in 32 bits for any packet */
+    return (bits * ((uint16_t)br[0] << 8 | br[1]) + RFM69_FXOSC / 1000 - 1)
+        / (RFM69_FXOSC / 1000);
+}
+
+/**
+ * Poll a register until the bits in mask read as val.
+ * @param reg The register to poll
+ * @param mask The bits to look at
+ * @param val The value they must have
+ * @param deadline The tick count at which to give up
+ * @returns RFM_OK for success, RFM_FAIL for failure, RFM_TIMEOUT if the
+ * deadline passed first.
+ */
+static rfm_status_t _rf69_wait(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t mask, const rfm_reg_t val, const uint32_t deadline)
+{
+    rfm_reg_t res;
+
+    for (;;) {
+        if (_rf69_read(dev, reg, &res) != RFM_OK)
+            return RFM_FAIL;
+        if ((res & mask) == val)
+            return RFM_OK;
+        if (_rf69_expired(dev, deadline))
+            return RFM_TIMEOUT;
+    }
+}
+
 /**
  * Read a single byte from a register in the RFM69. Transmit the (one byte)
  * address of the register to be read, then read the (one byte) response.
@@ -77,21 +336,23 @@ rfm_status_t rf69_init(void)
  * @param result A pointer to where to put the result
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-static rfm_status_t _rf69_read(const rfm_reg_t reg, rfm_reg_t* result)
+static rfm_status_t _rf69_read(rf69_dev_t* dev, const rfm_reg_t reg,
+        rfm_reg_t* result)
 {
-    rfm_reg_t data;
+    rfm_reg_t out[2], in[2];
+    rfm_status_t res;
 
-    spi_ss_assert();
+    /* Transmit the reg we want to read from, then read the data back */
+    out[0] = reg & ~RFM69_SPI_WRITE_MASK;
+    out[1] = 0xFF;
 
-    /* Transmit the reg we want to read from */
-    spi_exchange_single(reg, &data);
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, out, in, 2);
+    _rf69_deselect(dev);
 
-    /* Read the data back */
-    spi_exchange_single(0xFF, result);
+    *result = in[1];
 
-    spi_ss_deassert();
-
-    return RFM_OK;
+    return res;
 }
 
 /**
@@ -102,312 +363,2624 @@ static rfm_status_t _rf69_read(const rfm_reg_t reg, rfm_reg_t* result)
  * @param val The value for the address
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-static rfm_status_t _rf69_write(const rfm_reg_t reg, const rfm_reg_t val)
+static rfm_status_t _rf69_write(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t val)
 {
-    rfm_reg_t dummy;
-
-    spi_ss_assert();
+    rfm_reg_t out[2];
+    rfm_status_t res;
+    int8_t idx;
 
-    /* Transmit the reg address */
-    spi_exchange_single(reg | RFM69_SPI_WRITE_MASK, &dummy);
+    /* Transmit the reg address, then the value for this address */
+    out[0] = reg | RFM69_SPI_WRITE_MASK;
+    out[1] = val;
 
-    /* Transmit the value for this address */
-    spi_exchange_single(val, &dummy);
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, out, NULL, 2);
+    _rf69_deselect(dev);
 
-    spi_ss_deassert();
+    /* Keep the shadow in step with the chip */
+    idx = _rf69_shadow_index(reg);
+    if (idx >= 0)
+        dev->shadow[idx] = val & _rf69_shadow_mask(reg);
 
-    return RFM_OK;
+    return res;
 }
 
 /**
- * Read a given number of bytes from the given register address into a 
- * provided buffer
- * @param reg The address of the register to start from
- * @param dest A pointer into the destination buffer
- * @param len The number of bytes to read
+ * Change some of the bits in a register. If the register is shadowed the
+ * current value comes from the shadow and only a single write transaction is
+ * needed, otherwise the register is read back from the RFM69 first.
+ * @param reg The address of the register to modify
+ * @param mask The bits of the register to change
+ * @param val The new value of the bits selected by mask
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-static rfm_status_t _rf69_burst_read(const rfm_reg_t reg, rfm_reg_t* dest, 
-        uint8_t len)
+static rfm_status_t _rf69_modify(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t mask, const rfm_reg_t val)
 {
-    rfm_reg_t dummy;
-
-    spi_ss_assert();
-    
-    /* Send the start address with the write mask off */
-    spi_exchange_single(reg & ~RFM69_SPI_WRITE_MASK, &dummy);
-    
-    while (len--) {
-        spi_exchange_single(0xFF, dest);
-        dest++;
-    }
+    rfm_reg_t res;
+    int8_t idx;
 
-    spi_ss_deassert();
+    idx = _rf69_shadow_index(reg);
+    if (dev->shadow_valid && idx >= 0)
+        res = dev->shadow[idx];
+    else if (_rf69_read(dev, reg, &res) != RFM_OK)
+        return RFM_FAIL;
 
-    return RFM_OK;
+    return _rf69_write(dev, reg, (res & ~mask) | (val & mask));
 }
 
 /**
- * Write data into the FIFO on the RFM69
- * @param src The source data comes from this buffer
- * @param len Write this number of bytes from the buffer into the FIFO
+ * Write a register only if the shadow says it holds a different value.
+ * Registers that are not shadowed are always written.
+ * @param reg The address of the register to write
+ * @param val The value for the address
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-static rfm_status_t _rf69_fifo_write(const rfm_reg_t* src, uint8_t len)
+static rfm_status_t _rf69_write_cached(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t val)
 {
-    rfm_reg_t dummy;
+    int8_t idx;
 
-    spi_ss_assert();
-    
-    /* Send the start address with the write mask on */
-    spi_exchange_single(RFM69_REG_00_FIFO | RFM69_SPI_WRITE_MASK, &dummy);
-    
-    /* First byte is packet length */
-    spi_exchange_single(len, &dummy);
+    idx = _rf69_shadow_index(reg);
+    if (dev->shadow_valid && idx >= 0 && dev->shadow[idx] == val)
+        return RFM_OK;
 
-    /* Then write the packet */
-    while (len--)
-        spi_exchange_single(*src++, &dummy);
+    return _rf69_write(dev, reg, val);
+}
 
-    spi_ss_deassert();
+/**
+ * Get the value of a register from the shadow if it is shadowed, otherwise
+ * read it from the RFM69.
+ * @param reg The register address to be read
+ * @param result A pointer to where to put the result
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_read_cached(rf69_dev_t* dev, const rfm_reg_t reg,
+        rfm_reg_t* result)
+{
+    int8_t idx;
 
-    return RFM_OK;
+    idx = _rf69_shadow_index(reg);
+    if (dev->shadow_valid && idx >= 0) {
+        *result = dev->shadow[idx];
+        return RFM_OK;
+    }
+
+    return _rf69_read(dev, reg, result);
 }
 
 /**
- * Change the RFM69 operating mode to a new one.
- * @param newMode The value representing the new mode (see datasheet for
- * further information). The MODE bits are masked in the register, i.e. only
- * bits 2-4 of newMode are ovewritten in the register.
+ * Read a run of consecutive registers in a single transaction, relying on
+ * the RFM69's address auto-increment.
+ * @param reg The address of the first register to be read
+ * @param dest A pointer to where to put the results
+ * @param len The number of registers to read
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-rfm_status_t rf69_set_mode(const rfm_reg_t newMode)
+static rfm_status_t _rf69_burst_read(rf69_dev_t* dev, const rfm_reg_t reg,
+        rfm_reg_t* dest, uint8_t len)
 {
-    rfm_reg_t res;
-    _rf69_read(RFM69_REG_01_OPMODE, &res);
-    _rf69_write(RFM69_REG_01_OPMODE, (res & 0xE3) | newMode);
-    _mode = newMode;
-    return RFM_OK;
+    rfm_reg_t addr;
+    rfm_status_t res;
+
+    addr = reg & ~RFM69_SPI_WRITE_MASK;
+
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, &addr, NULL, 1);
+    if (res == RFM_OK)
+        res = _rf69_transfer(dev, NULL, dest, len);
+    _rf69_deselect(dev);
+
+    return res;
 }
 
 /**
- * Get data from the RFM69 receive buffer.
- * @param buf A pointer into the local buffer in which we would like the data.
- * @param len The length of the data
- * @param lastrssi The RSSI of the packet we're getting
- * @param rfm_packet_waiting A boolean pointer which is true if a packet was
- * received and has been put into the buffer buf, false if there was no packet
- * to get from the RFM69.
+ * Write a run of consecutive registers in a single transaction, relying on
+ * the RFM69's address auto-increment, and update the shadow to match.
+ * @param reg The address of the first register to be written
+ * @param src The values to write, which may be in the shadow itself
+ * @param len The number of registers to write
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-rfm_status_t rf69_receive(rfm_reg_t* buf, rfm_reg_t* len, int16_t* lastrssi,
-        bool* rfm_packet_waiting)
+static rfm_status_t _rf69_burst_write(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t* src, uint8_t len)
 {
-    rfm_reg_t res;
+    rfm_reg_t addr;
+    rfm_status_t res;
+    uint8_t idx, i;
 
-    if(_mode != RFM69_MODE_RX)
-    {
-        rf69_set_mode(RFM69_MODE_RX);
+    addr = reg | RFM69_SPI_WRITE_MASK;
+
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, &addr, NULL, 1);
+    if (res == RFM_OK)
+        res = _rf69_transfer(dev, src, NULL, len);
+    _rf69_deselect(dev);
+
+    /* Keep the shadow in step with the chip, walking CONFIG alongside the
+     * run rather than looking each register up */
+    idx = _rf69_shadow_first(reg);
+    for (i = 0; i < len && idx < RFM69_CONFIG_SIZE; i++) {
+        if (CONFIG[idx][0] == reg + i) {
+            dev->shadow[idx] = src[i] & _rf69_shadow_mask(reg + i);
+            idx++;
+        }
     }
 
-    /* Check IRQ register for payloadready flag
-     * (indicates RXed packet waiting in FIFO) */
-    _rf69_read(RFM69_REG_28_IRQ_FLAGS2, &res);
-    if (res & RF_IRQFLAGS2_PAYLOADREADY)
-    {
-        /* Get packet length from first byte of FIFO */
-        _rf69_read(RFM69_REG_00_FIFO, len);
-        *len += 1;
-        /* Read FIFO into our Buffer */
-        _rf69_burst_read(RFM69_REG_00_FIFO, buf, RFM69_FIFO_SIZE);
-        /* Read RSSI register (should be of the packet? - TEST THIS) */
-        _rf69_read(RFM69_REG_24_RSSI_VALUE, &res);
-        *lastrssi = -(res/2);
-        /* Clear the radio FIFO (found in HopeRF demo code) */
-        _rf69_clear_fifo();
+    return res;
+}
 
-        *rfm_packet_waiting = true;
-        return RFM_OK;
+/**
+ * Write a run of consecutive registers from the first one that differs from
+ * the shadow through to the end of the run, in a single transaction. Ending
+ * on the last register suits FRF, which only takes effect once the LSB is
+ * written. Nothing is sent if the whole run matches the shadow.
+ * @param reg The address of the first register in the run
+ * @param src The values for the run
+ * @param len The number of registers in the run
+ * @param changed A pointer to a bool that is set true if anything was written
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_write_cached_run(rf69_dev_t* dev,
+        const rfm_reg_t reg, const rfm_reg_t* src, uint8_t len,
+        bool* changed)
+{
+    uint8_t idx, i;
+
+    idx = _rf69_shadow_first(reg);
+    for (i = 0; i < len; i++, idx++) {
+        if (!dev->shadow_valid || idx >= RFM69_CONFIG_SIZE
+                || CONFIG[idx][0] != reg + i || dev->shadow[idx] != src[i])
+            break;
     }
 
-    *rfm_packet_waiting = false;
+    *changed = i < len;
+    if (i == len)
+        return RFM_OK;
+
+    return _rf69_burst_write(dev, reg + i, src + i, len - i);
+}
+
+/**
+ * Write new values for a run of frequency or bit rate registers, restarting
+ * the receiver if it is running and anything changed.
+ * @param reg The address of the first register in the run
+ * @param src The values for the run
+ * @param len The number of registers in the run
+ * @returns RFM_OK for success, RFM_FAIL if a transmission is in progress.
+ */
+static rfm_status_t _rf69_retune(rf69_dev_t* dev, const rfm_reg_t reg,
+        const rfm_reg_t* src, uint8_t len)
+{
+    bool changed;
+
+    /* Don't pull the carrier out from under a packet */
+    if (dev->tx_busy)
+        return RFM_FAIL;
+
+    if (_rf69_write_cached_run(dev, reg, src, len, &changed) != RFM_OK)
+        return RFM_FAIL;
+
+    if (changed && dev->mode == RFM69_MODE_RX)
+        return _rf69_rx_restart(dev);
+
     return RFM_OK;
 }
 
 /**
- * Send a packet using the RFM69 radio.
- * @param data The data buffer that contains the string to transmit
- * @param len The number of bytes in the data packet (excluding preamble, sync
- * and checksum)
- * @param power The transmit power to be used in dBm
+ * Restart the receiver, abandoning any packet in progress. A single write
+ * since the rest of RegPacketConfig2 comes from the shadow.
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-rfm_status_t rf69_send(const rfm_reg_t* data, uint8_t len, 
-        const uint8_t power)
+static rfm_status_t _rf69_rx_restart(rf69_dev_t* dev)
 {
-    rfm_reg_t oldMode, res;
-    uint8_t paLevel;
+    dev->rxs_active = false;
+    return _rf69_modify(dev, RFM69_REG_3D_PACKET_CONFIG2,
+            RF_PACKET2_RXRESTART, RF_PACKET2_RXRESTART);
+}
 
-    /* power is TX Power in dBmW (valid values are 2dBmW-20dBmW) */
-    if (power < 2 || power > 20)
-    {
-        /* Could be dangerous, so let's check this */
-        return RFM_FAIL;
+/**
+ * Find the first shadow slot for a register at or above an address, by
+ * binary search since CONFIG is in ascending register order.
+ * @param reg The register address
+ * @returns The index into the device shadow, RFM69_CONFIG_SIZE if every
+ * shadowed register is below reg
+ */
+static uint8_t _rf69_shadow_first(const rfm_reg_t reg)
+{
+    uint8_t lo = 0, hi = RFM69_CONFIG_SIZE, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (CONFIG[mid][0] < reg)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    oldMode = _mode;
-    
-    /* Start transmitter */
-    rf69_set_mode(RFM69_MODE_TX);
+    return lo;
+}
 
-    /* Set up PA */
-    if (power <= 17) {
-        /* Set PA Level */
-        paLevel = power + 28;
-        _rf69_write(RFM69_REG_11_PA_LEVEL, RF_PALEVEL_PA0_ON | RF_PALEVEL_PA1_OFF | RF_PALEVEL_PA2_OFF | paLevel);        
-    } else {
-        /* Disable Over Current Protection */
-        _rf69_write(RFM69_REG_13_OCP, RF_OCP_OFF);
-        /* Enable High Power Registers */
-        _rf69_write(RFM69_REG_5A_TEST_PA1, 0x5D);
-        _rf69_write(RFM69_REG_5C_TEST_PA2, 0x7C);
-        /* Set PA Level */
-        paLevel = power + 11;
-        _rf69_write(RFM69_REG_11_PA_LEVEL, RF_PALEVEL_PA0_OFF | RF_PALEVEL_PA1_ON | RF_PALEVEL_PA2_ON | paLevel);
+/**
+ * Find the shadow slot for a register.
+ * @param reg The register address
+ * @returns The index into the device shadow, or -1 if the register is not
+ * shadowed
+ */
+static int8_t _rf69_shadow_index(const rfm_reg_t reg)
+{
+    uint8_t i;
+
+    i = _rf69_shadow_first(reg);
+    if (i < RFM69_CONFIG_SIZE && CONFIG[i][0] == reg)
+        return i;
+
+    return -1;
+}
+
+/**
+ * Get the bits of a shadowed register that read back as written. Status and
+ * trigger bits are excluded since the chip changes them by itself.
+ * @param reg The register address
+ * @returns A mask of the bits that can be compared against the shadow
+ */
+static rfm_reg_t _rf69_shadow_mask(const rfm_reg_t reg)
+{
+    switch (reg) {
+        case RFM69_REG_01_OPMODE:
+            return ~RF_OPMODE_LISTENABORT;
+        case RFM69_REG_1E_AFC_FEI:
+            return RF_AFCFEI_AFCAUTOCLEAR_ON | RF_AFCFEI_AFCAUTO_ON;
+        case RFM69_REG_3D_PACKET_CONFIG2:
+            return ~RF_PACKET2_RXRESTART;
+        default:
+            return 0xFF;
     }
+}
 
-    /* Wait for PA ramp-up */
-    res = 0;
-    while (!(res & RF_IRQFLAGS1_TXREADY))
-        _rf69_read(RFM69_REG_27_IRQ_FLAGS1, &res);
+/**
+ * Reload the register shadow from the RFM69, e.g. after the radio has been
+ * power cycled or reconfigured behind the library's back.
+ * @param dev The radio to use
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_shadow_sync(rf69_dev_t* dev)
+{
+    uint8_t i;
 
-    /* Throw Buffer into FIFO, packet transmission will start 
-     * automatically */
-    _rf69_fifo_write(data, len);
+    for (i = 0; i < RFM69_CONFIG_SIZE; i++)
+        if (_rf69_read(dev, CONFIG[i][0], &dev->shadow[i]) != RFM_OK)
+            return RFM_FAIL;
 
-    /* Wait for packet to be sent */
-    res = 0;
-    while (!(res & RF_IRQFLAGS2_PACKETSENT))
-        _rf69_read(RFM69_REG_28_IRQ_FLAGS2, &res);
+    dev->shadow_valid = true;
+    dev->mode = dev->shadow[_rf69_shadow_index(RFM69_REG_01_OPMODE)] & 0x1C;
+
+    return RFM_OK;
+}
 
-    /* Return Transceiver to original mode */
-    rf69_set_mode(oldMode);
+/**
+ * Check the register shadow against the contents of the RFM69.
+ * @param dev The radio to use
+ * @param match A pointer to a bool that is set true if every shadowed
+ * register matches the chip, false otherwise
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_shadow_verify(rf69_dev_t* dev, bool* match)
+{
+    rfm_reg_t res, mask;
+    uint8_t i;
 
-    /* If we were in high power, switch off High Power Registers */
-    if (power > 17) {
-        /* Disable High Power Registers */
-        _rf69_write(RFM69_REG_5A_TEST_PA1, 0x55);
-        _rf69_write(RFM69_REG_5C_TEST_PA2, 0x70);
-        /* Enable Over Current Protection */
-        _rf69_write(RFM69_REG_13_OCP, RF_OCP_ON | RF_OCP_TRIM_95);
+    *match = dev->shadow_valid;
+    for (i = 0; i < RFM69_CONFIG_SIZE && *match; i++) {
+        if (_rf69_read(dev, CONFIG[i][0], &res) != RFM_OK)
+            return RFM_FAIL;
+        mask = _rf69_shadow_mask(CONFIG[i][0]);
+        if ((res & mask) != (dev->shadow[i] & mask))
+            *match = false;
     }
 
     return RFM_OK;
 }
 
 /**
- * Clear the FIFO in the RFM69. We do this by entering STBY mode and then
- * returing to RX mode.
- * @warning Must only be called in RX Mode
- * @note Apparently this works... found in HopeRF demo code
+ * Read a packet out of the FIFO on the RFM69 in a single transaction: the
+ * length byte first, then exactly that many payload bytes.
+ * @param dest A pointer into the destination buffer
+ * @param len A pointer into which the packet length is placed. This is the
+ * number of bytes written to dest.
+ * @param maxlen The size of the destination buffer, longer packets are
+ * truncated
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-static rfm_status_t _rf69_clear_fifo(void)
+static rfm_status_t _rf69_fifo_read(rf69_dev_t* dev, rfm_reg_t* dest,
+        rfm_reg_t* len, const uint8_t maxlen)
 {
-    rf69_set_mode(RFM69_MODE_STDBY);
-    rf69_set_mode(RFM69_MODE_RX);
-    return RFM_OK;
+    rfm_reg_t out[2], in[2];
+    rfm_status_t res;
+
+    /* Send the FIFO address with the write mask off, then clock out the
+     * packet length */
+    out[0] = RFM69_REG_00_FIFO & ~RFM69_SPI_WRITE_MASK;
+    out[1] = 0xFF;
+
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, out, in, 2);
+    *len = in[1] > maxlen ? maxlen : in[1];
+
+    /* Then only as much of the FIFO as the packet occupies */
+    if (res == RFM_OK)
+        res = _rf69_transfer(dev, NULL, dest, *len);
+    _rf69_deselect(dev);
+
+    return res;
 }
 
 /**
- * The RFM69 has an onboard temperature sensor, read its value
- * @warning RFM69 must be in one of the active modes for temp sensor to work.
- * @param temperature A pointer to the variable into which the temperature will
- * be read by this method.
- * @returns RFM_OK for success, RFM_FAIL for failure, RFM_TIMEOUT if there is a
- * timeout due to the sensor on the RFM not starting and/or finishing a
- * conversion.
+ * Write the start of a packet into the FIFO on the RFM69
+ * @param addr The address byte to put in front of the data, or NULL for none
+ * @param src The source data comes from this buffer
+ * @param len The length of the data, written as the first byte (plus one
+ * for the address byte)
+ * @param count Write this number of bytes from the buffer into the FIFO. If
+ * less than len, the rest must follow with _rf69_fifo_append().
+ * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-rfm_status_t rf69_read_temp(int8_t* temperature)
+static rfm_status_t _rf69_fifo_write(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* src, uint8_t len, uint8_t count)
 {
-    /* Store current transceiver mode */
-    rfm_reg_t oldMode, temp;
-    uint8_t timeout;
-    
-    oldMode = _mode;
-    /* Set mode into Standby (required for temperature measurement) */
-    rf69_set_mode(RFM69_MODE_STDBY);
-
-    /* Trigger Temperature Measurement */
-    _rf69_write(RFM69_REG_4E_TEMP1, RF_TEMP1_MEAS_START);
-
-    /* Check Temperature Measurement has started */
-    timeout = 0;
-    temp = 0;
-    while (!(RF_TEMP1_MEAS_RUNNING & temp)) {
-        _rf69_read(RFM69_REG_4E_TEMP1, &temp);
-        _delay_ms(1);
-        if(++timeout > 50)
-        {
-            *temperature = -127.0;
-            return RFM_TIMEOUT;
-        }
-        _rf69_write(RFM69_REG_4E_TEMP1, RF_TEMP1_MEAS_START);
-    }
+    rfm_reg_t hdr[3];
+    rfm_status_t res;
 
-    /* Wait for Measurement to complete */
-    timeout = 0;
-    temp = 0;
-    while (RF_TEMP1_MEAS_RUNNING & temp) {
-        _rf69_read(RFM69_REG_4E_TEMP1, &temp);
-        _delay_ms(1);
-        if(++timeout > 10)
-        {
-            *temperature = -127.0;
-            return RFM_TIMEOUT;
-        }
-    }
+    /* Send the start address with the write mask on, then the packet
+     * length as the first byte and the address byte, if any */
+    hdr[0] = RFM69_REG_00_FIFO | RFM69_SPI_WRITE_MASK;
+    hdr[1] = addr ? len + 1 : len;
+    hdr[2] = addr ? *addr : 0;
 
-    /* Read raw ADC value */
-    temp = 0;
-    _rf69_read(RFM69_REG_4F_TEMP2, &temp);
-	
-    /* Set transceiver back to original mode */
-    rf69_set_mode(oldMode);
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, hdr, NULL, addr ? 3 : 2);
 
-    /* Return processed temperature value */
-    *temperature = 161 - (int8_t)temp;
+    /* Then write the packet */
+    if (res == RFM_OK)
+        res = _rf69_transfer(dev, src, NULL, count);
+    _rf69_deselect(dev);
 
-    return RFM_OK;
+    return res;
 }
 
 /**
- * Get the last RSSI value from the RFM69
- * @warning Must only be called when the RFM69 is in rx mode
- * @param rssi A pointer to an int16_t where we will place the RSSI value
+ * Write more of a packet into the FIFO on the RFM69, without a length byte
+ * @param src The source data comes from this buffer
+ * @param count Write this number of bytes from the buffer into the FIFO
  * @returns RFM_OK for success, RFM_FAIL for failure.
  */
-rfm_status_t rf69_sample_rssi(int16_t* rssi)
+static rfm_status_t _rf69_fifo_append(rf69_dev_t* dev, const rfm_reg_t* src,
+        uint8_t count)
 {
-    rfm_reg_t res;
+    rfm_reg_t addr;
+    rfm_status_t res;
 
-    /* Must only be called in RX mode */
-    if (_mode != RFM69_MODE_RX)
-        return RFM_FAIL;
+    addr = RFM69_REG_00_FIFO | RFM69_SPI_WRITE_MASK;
 
-    /* Trigger RSSI Measurement */
-    _rf69_write(RFM69_REG_23_RSSI_CONFIG, RF_RSSI_START);
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, &addr, NULL, 1);
+    if (res == RFM_OK)
+        res = _rf69_transfer(dev, src, NULL, count);
+    _rf69_deselect(dev);
 
-    /* Wait for Measurement to complete */
-    while (!(RF_RSSI_DONE & res))
-        _rf69_read(RFM69_REG_23_RSSI_CONFIG, &res);
+    return res;
+}
 
-    /* Read, store in _lastRssi and return RSSI Value */
-    res = 0;
-    _rf69_read(RFM69_REG_24_RSSI_VALUE, &res);
-    *rssi = -(res/2);
+/**
+ * Read octets of a packet that is still arriving out of the FIFO on the
+ * RFM69, without a length byte
+ * @param dest The data is placed in this buffer
+ * @param count Read this number of bytes from the FIFO
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_fifo_drain(rf69_dev_t* dev, rfm_reg_t* dest,
+        uint8_t count)
+{
+    rfm_reg_t addr;
+    rfm_status_t res;
 
-    return RFM_OK;
+    addr = RFM69_REG_00_FIFO & ~RFM69_SPI_WRITE_MASK;
+
+    _rf69_select(dev);
+    res = _rf69_transfer(dev, &addr, NULL, 1);
+    if (res == RFM_OK)
+        res = _rf69_transfer(dev, NULL, dest, count);
+    _rf69_deselect(dev);
+
+    return res;
+}
+
+/**
+ * Change the RFM69 operating mode to a new one.
+ * @param dev The radio to use
+ * @param newMode The value representing the new mode (see datasheet for
+ * further information). The MODE bits are masked in the register, i.e. only
+ * bits 2-4 of newMode are ovewritten in the register. The other bits come
+ * from the register shadow so this is a single write. Entering RX also
+ * disengages the high power PA registers if they were left on.
+ *
+ * Entering STDBY or FS starts a temperature conversion if the cached reading
+ * is more than RFM69_TEMP_REFRESH_MS old, and leaving them collects it if it
+ * has finished, so the cache is kept fresh without stopping RX. The library
+ * only does this where it leaves the radio in STDBY or FS, not when it
+ * passes through them on the way to RX or TX.
+ *
+ * This also ends Listen mode if it is on.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_set_mode(rf69_dev_t* dev, const rfm_reg_t newMode)
+{
+    if (_rf69_set_mode(dev, newMode) != RFM_OK)
+        return RFM_FAIL;
+
+#if RFM69_TEMP_REFRESH_MS
+    if (RFM69_TEMP_MODE(newMode) && !dev->temp_running
+            && _rf69_millis(dev) - dev->temp_try_ms >= RFM69_TEMP_REFRESH_MS) {
+        dev->temp_restore = false;
+        _rf69_temp_trigger(dev);
+    }
+#endif
+
+    return RFM_OK;
+}
+
+/**
+ * Change the operating mode without starting a temperature conversion, for
+ * the library's own trips through STDBY and FS. Otherwise as
+ * rf69_set_mode().
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_set_mode(rf69_dev_t* dev, const rfm_reg_t newMode)
+{
+    /* High power settings must be off when receiving */
+    if (newMode == RFM69_MODE_RX && _rf69_pa_boost(dev, false) != RFM_OK)
+        return RFM_FAIL;
+
+    /* Listen mode is left by setting ListenAbort along with the new mode,
+     * which is then written again on its own below */
+    if (dev->listening) {
+        if (_rf69_modify(dev, RFM69_REG_01_OPMODE, RF_OPMODE_LISTEN_ON
+                    | RF_OPMODE_LISTENABORT | 0x1C,
+                    RF_OPMODE_LISTENABORT | newMode) != RFM_OK)
+            return RFM_FAIL;
+        dev->listening = false;
+    }
+
+    /* Leaving the modes the sensor runs in abandons a conversion */
+    if (dev->temp_running && !RFM69_TEMP_MODE(newMode))
+        _rf69_temp_abandon(dev);
+
+    if (_rf69_modify(dev, RFM69_REG_01_OPMODE, 0x1C, newMode) != RFM_OK)
+        return RFM_FAIL;
+    dev->mode = newMode;
+
+    return RFM_OK;
+}
+
+/**
+ * Retune the RFM69 to a new carrier frequency. Only the FRF bytes from the
+ * first one that changes through the LSB are written, in one transaction.
+ * There is no need to leave RX or FS: the synthesiser relocks when the LSB is
+ * written, and in RX the receiver is restarted so it doesn't keep a lock on
+ * the old channel.
+ * @param dev The radio to use
+ * @param hz The carrier frequency in Hz
+ * @returns RFM_OK for success, RFM_FAIL if the frequency is outside the
+ * RFM69's range or a transmission is in progress.
+ */
+rfm_status_t rf69_dev_set_frequency(rf69_dev_t* dev, const uint32_t hz)
+{
+    rfm_reg_t frf[3];
+
+    if (hz < 290000000UL || hz > 1020000000UL)
+        return RFM_FAIL;
+
+    _rf69_frf(hz, frf);
+    return _rf69_retune(dev, RFM69_REG_07_FRF_MSB, frf, 3);
+}
+
+/**
+ * Retune the RFM69 to a carrier given as its RegFrf bytes, e.g. from a table
+ * built with rf69_frf_bytes() in advance, so that hopping needs no
+ * arithmetic.
+ * Otherwise as rf69_set_frequency(). Parking the radio in FS between hops
+ * keeps the PLL running, so the next send starts without waiting for it.
+ * @param dev The radio to use
+ * @param frf The three bytes for RegFrfMsb through RegFrfLsb
+ * @returns RFM_OK for success, RFM_FAIL if a transmission is in progress.
+ */
+rfm_status_t rf69_dev_set_frf(rf69_dev_t* dev, const rfm_reg_t* frf)
+{
+    return _rf69_retune(dev, RFM69_REG_07_FRF_MSB, frf, 3);
+}
+
+/**
+ * Work out the RegFrf bytes for a carrier frequency, for rf69_set_frf(). Unlike
+ * RFM69_FRF(), which is meant for constants, this needs only 32 bit
+ * arithmetic at run time.
+ * @param hz The carrier frequency in Hz
+ * @param frf Where to put the three bytes for RegFrfMsb through RegFrfLsb
+ * @returns RFM_OK for success, RFM_FAIL if the frequency is outside the
+ * RFM69's range.
+ */
+rfm_status_t rf69_frf_bytes(const uint32_t hz, rfm_reg_t* frf)
+{
+    if (hz < 290000000UL || hz > 1020000000UL)
+        return RFM_FAIL;
+
+    _rf69_frf(hz, frf);
+    return RFM_OK;
+}
+
+/**
+ * Work out the RegFrf bytes for a carrier frequency.
+ * @param hz The carrier frequency in Hz
+ * @param frf The three bytes for RegFrfMsb through RegFrfLsb
+ */
+static void _rf69_frf(const uint32_t hz, rfm_reg_t* frf)
+{
+    uint32_t v;
+
+    /* hz * 2^19 / FXOSC, split so that it fits in 32 bits */
+    v = (hz / RFM69_FSTEP_DIV) * 256
+        + ((hz % RFM69_FSTEP_DIV) * 256 + RFM69_FSTEP_DIV / 2)
+            / RFM69_FSTEP_DIV;
+    frf[0] = RFM69_BYTE(v, 2);
+    frf[1] = RFM69_BYTE(v, 1);
+    frf[2] = RFM69_BYTE(v, 0);
+}
+
+/**
+ * Measure the RSSI at each of a range of frequencies, e.g. to find a clear
+ * channel or an interferer. The radio stays in RX for the whole sweep: each
+ * step writes only the FRF bytes that change, restarts the receiver, waits
+ * for it to be ready and takes one RSSI sample. Afterwards the radio is retuned to its own channel
+ * and returned to its previous mode, or to Listen mode if it was listening.
+ * @param dev The radio to use
+ * @param start_hz The first frequency to measure, in Hz
+ * @param stop_hz The last frequency to measure, in Hz, if a whole number of
+ * steps from start_hz
+ * @param step_hz The spacing between measurements, in Hz
+ * @param out Filled in with the RSSI in dBm at each frequency. Must have room
+ * for RFM69_SWEEP_POINTS(start_hz, stop_hz, step_hz) values.
+ * @returns RFM_OK for success, RFM_FAIL if the range is outside the RFM69's
+ * or a transmission is in progress, RFM_TIMEOUT if the receiver wasn't ready
+ * on a channel or a sample didn't complete within RFM69_TIMEOUT_MS.
+ */
+rfm_status_t rf69_dev_rssi_sweep(rf69_dev_t* dev, const uint32_t start_hz,
+        const uint32_t stop_hz, const uint32_t step_hz, int16_t* out)
+{
+    rfm_reg_t frf[3], old[3], res[2];
+    rfm_reg_t oldMode;
+    rfm_status_t status;
+    uint32_t hz, deadline;
+    bool changed, listen;
+    uint8_t i;
+
+    if (dev->tx_busy || !step_hz || stop_hz < start_hz
+            || start_hz < 290000000UL || stop_hz > 1020000000UL)
+        return RFM_FAIL;
+
+    for (i = 0; i < 3; i++)
+        _rf69_read_cached(dev, RFM69_REG_07_FRF_MSB + i, &old[i]);
+    oldMode = dev->mode;
+    listen = dev->listening;
+
+    if (dev->mode != RFM69_MODE_RX || dev->listening)
+        _rf69_set_mode(dev, RFM69_MODE_RX);
+
+    for (hz = start_hz; ; hz += step_hz) {
+        _rf69_frf(hz, frf);
+        _rf69_write_cached_run(dev, RFM69_REG_07_FRF_MSB, frf, 3, &changed);
+
+        /* PllLock can still be set from the old channel. Restarting the
+         * receiver makes it settle on the new one before RxReady. */
+        if (changed)
+            _rf69_rx_restart(dev);
+        deadline = _rf69_millis(dev) + RFM69_TIMEOUT_MS;
+        status = _rf69_wait(dev, RFM69_REG_27_IRQ_FLAGS1,
+                RF_IRQFLAGS1_RXREADY | RF_IRQFLAGS1_PLLLOCK,
+                RF_IRQFLAGS1_RXREADY | RF_IRQFLAGS1_PLLLOCK, deadline);
+        if (status != RFM_OK)
+            break;
+
+        /* RssiConfig and RssiValue are next to each other, so the sample
+         * comes back with the flag that says it is done */
+        _rf69_write(dev, RFM69_REG_23_RSSI_CONFIG, RF_RSSI_START);
+        do {
+            status = _rf69_burst_read(dev, RFM69_REG_23_RSSI_CONFIG, res, 2);
+            if (!(res[0] & RF_RSSI_DONE) && _rf69_expired(dev, deadline))
+                status = RFM_TIMEOUT;
+        } while (status == RFM_OK && !(res[0] & RF_RSSI_DONE));
+        if (status != RFM_OK)
+            break;
+        *out++ = -(res[1]/2);
+
+        if (stop_hz - hz < step_hz)
+            break;
+    }
+
+    /* Back to our own channel */
+    _rf69_write_cached_run(dev, RFM69_REG_07_FRF_MSB, old, 3, &changed);
+    if (listen || oldMode != RFM69_MODE_RX)
+        _rf69_mode_restore(dev, oldMode, listen);
+    else if (changed)
+        _rf69_rx_restart(dev);
+
+    return status;
+}
+
+/**
+ * Change the RFM69 bit rate, in one transaction if both bytes change. As with
+ * rf69_set_frequency() the receiver is restarted if it is running.
+ * @param dev The radio to use
+ * @param bps The bit rate in bps
+ * @returns RFM_OK for success, RFM_FAIL if the bit rate is out of range or a
+ * transmission is in progress.
+ */
+rfm_status_t rf69_dev_set_bitrate(rf69_dev_t* dev, const uint32_t bps)
+{
+    rfm_reg_t br[2];
+    uint32_t v;
+
+    if (bps < 1200UL || bps > 300000UL)
+        return RFM_FAIL;
+
+    v = (RFM69_FXOSC + bps / 2) / bps;
+    br[0] = RFM69_BYTE(v, 1);
+    br[1] = RFM69_BYTE(v, 0);
+
+    return _rf69_retune(dev, RFM69_REG_03_BITRATE_MSB, br, 2);
+}
+
+/**
+ * Switch to a set of radio parameters built with RFM69_PROFILE(). Bit rate,
+ * deviation and frequency sit in consecutive registers, so whatever has
+ * changed goes out in one burst, then RxBw if it differs. The receiver is
+ * restarted if it is running.
+ * @param dev The radio to use
+ * @param profile The parameters to use
+ * @returns RFM_OK for success, RFM_FAIL if a transmission is in progress.
+ */
+rfm_status_t rf69_dev_apply_profile(rf69_dev_t* dev,
+        const rf69_profile_t* profile)
+{
+    rfm_reg_t rxbw;
+    bool changed, bw_changed;
+
+    if (dev->tx_busy)
+        return RFM_FAIL;
+
+    if (_rf69_write_cached_run(dev, RFM69_REG_03_BITRATE_MSB, profile->regs,
+                sizeof(profile->regs), &changed) != RFM_OK)
+        return RFM_FAIL;
+
+    /* Keep the DCC cutoff */
+    _rf69_read_cached(dev, RFM69_REG_19_RX_BW, &rxbw);
+    rxbw = (rxbw & 0xE0) | (profile->rxbw & 0x1F);
+    if (_rf69_write_cached_run(dev, RFM69_REG_19_RX_BW, &rxbw, 1,
+                &bw_changed) != RFM_OK)
+        return RFM_FAIL;
+
+    if ((changed || bw_changed) && dev->mode == RFM69_MODE_RX)
+        return _rf69_rx_restart(dev);
+
+    return RFM_OK;
+}
+
+/**
+ * Get data from the RFM69 receive buffer.
+ * @param dev The radio to use
+ * @param buf A pointer into the local buffer in which we would like the data.
+ * Must be at least RFM69_FIFO_SIZE bytes long, only the bytes of the packet
+ * itself are written. While address filtering is on, the first byte is the
+ * address the packet was sent to.
+ * @param len The length of the data plus one
+ * @param lastrssi The RSSI of the packet we're getting
+ * @param rfm_packet_waiting A boolean pointer which is true if a packet was
+ * received and has been put into the buffer buf, false if there was no packet
+ * to get from the RFM69.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_receive(rf69_dev_t* dev, rfm_reg_t* buf, rfm_reg_t* len,
+        int16_t* lastrssi, bool* rfm_packet_waiting)
+{
+    rf69_rx_info_t info;
+    rfm_status_t status;
+
+    status = _rf69_receive(dev, buf, len, &info, false, rfm_packet_waiting);
+    if (*rfm_packet_waiting)
+        *lastrssi = info.rssi;
+    return status;
+}
+
+/**
+ * Get data from the RFM69 receive buffer as rf69_receive() does, along with
+ * the RSSI, frequency error and AFC correction of the packet and when it was
+ * collected. These are fetched in one burst before the FIFO is read, while
+ * the radio still holds them for this packet.
+ * @param dev The radio to use
+ * @param buf A pointer into the local buffer in which we would like the data.
+ * Must be at least RFM69_FIFO_SIZE bytes long.
+ * @param len The length of the data plus one
+ * @param info Filled in with what is known about the packet
+ * @param rfm_packet_waiting A boolean pointer which is true if a packet was
+ * received and has been put into the buffer buf, false if there was no packet
+ * to get from the RFM69.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_receive_info(rf69_dev_t* dev, rfm_reg_t* buf,
+        rfm_reg_t* len, rf69_rx_info_t* info, bool* rfm_packet_waiting)
+{
+    return _rf69_receive(dev, buf, len, info, true, rfm_packet_waiting);
+}
+
+/**
+ * Get data from the RFM69 receive buffer, for rf69_receive() and
+ * rf69_receive_info().
+ * @param info Filled in for a packet, with only the RSSI unless full is set
+ * @param full True to fetch everything in rf69_rx_info_t
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_receive(rf69_dev_t* dev, rfm_reg_t* buf,
+        rfm_reg_t* len, rf69_rx_info_t* info, const bool full,
+        bool* rfm_packet_waiting)
+{
+    rfm_reg_t res;
+
+    /* Don't cut short an asynchronous transmission */
+    if (dev->tx_busy)
+    {
+        *rfm_packet_waiting = false;
+        return RFM_OK;
+    }
+
+    /* Only accept what the FIFO can hold in one go */
+    _rf69_rx_fifo_reset(dev);
+
+    /* In Listen mode the radio wakes up to receive by itself */
+    if(dev->mode != RFM69_MODE_RX && !dev->listening)
+    {
+        _rf69_set_mode(dev, RFM69_MODE_RX);
+    }
+
+    /* Check IRQ register for payloadready flag
+     * (indicates RXed packet waiting in FIFO) */
+    _rf69_read(dev, RFM69_REG_28_IRQ_FLAGS2, &res);
+    if (res & RF_IRQFLAGS2_PAYLOADREADY)
+    {
+        /* The RSSI (and AFC and FEI) of the packet, before emptying the
+         * FIFO restarts the receiver */
+        _rf69_rx_info(dev, info, full);
+        /* Get packet length from first byte of FIFO and the packet itself
+         * into our Buffer in one go */
+        _rf69_fifo_read(dev, buf, len, RFM69_FIFO_SIZE);
+        *len += 1;
+        /* Clear the radio FIFO (found in HopeRF demo code), or go back to
+         * listening, which clears it on the next wake up */
+        if (dev->listening)
+            _rf69_listen_resume(dev);
+        else
+            _rf69_clear_fifo(dev);
+
+        *rfm_packet_waiting = true;
+        return RFM_OK;
+    }
+
+    *rfm_packet_waiting = false;
+    return RFM_OK;
+}
+
+/**
+ * Read what the radio knows about the packet in its FIFO. AfcValue,
+ * FeiValue and RssiValue are close enough together to come in one burst.
+ * @param info Filled in with the RSSI and the time, and the AFC correction
+ * and frequency error if full is set (otherwise they are zero)
+ * @param full True to fetch AFC and FEI as well as the RSSI
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_rx_info(rf69_dev_t* dev, rf69_rx_info_t* info,
+        const bool full)
+{
+    rfm_reg_t regs[6];
+    rfm_status_t res;
+
+    info->ms = _rf69_millis(dev);
+    if (full) {
+        res = _rf69_burst_read(dev, RFM69_REG_1F_AFC_MSB, regs, 6);
+    } else {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+        res = _rf69_read(dev, RFM69_REG_24_RSSI_VALUE, &regs[5]);
+    }
+
+    /* Both are signed, in Fstep units of RFM69_FSTEP_DIV / 256 Hz */
+    info->afc_hz = (int32_t)(int16_t)((regs[0] << 8) | regs[1])
+        * (int32_t)RFM69_FSTEP_DIV / 256;
+    info->fei_hz = (int32_t)(int16_t)((regs[2] << 8) | regs[3])
+        * (int32_t)RFM69_FSTEP_DIV / 256;
+    info->rssi = -(regs[5]/2);
+    return res;
+}
+
+/**
+ * Handle an interrupt on the DIO0 pin. Call this from the interrupt handler
+ * for DIO0.
+ *
+ * In RX mode CONFIG maps DIO0 to PayloadReady: the received packet is
+ * drained from the RFM69 into the receive ring. Because the interrupt tells
+ * us a packet is waiting, IRQ_FLAGS2 is not read. If the ring is full the
+ * packet is discarded.
+ *
+ * During rf69_send_start() DIO0 is mapped to PacketSent: the transmission
+ * is flagged as complete without any SPI traffic, and the next
+ * rf69_send_poll() restores the radio.
+ * @warning This uses the SPI bus. The main loop must mask the DIO0 interrupt
+ * around any other library call, except rf69_receive_pop() which does not
+ * touch SPI.
+ * @param dev The radio to use
+ * @returns RFM_OK for success, RFM_FAIL if the radio was neither receiving
+ * nor sending asynchronously, or if RFM69_RX_RING_SIZE is 0, in which case
+ * a packet is left in the FIFO for rf69_receive().
+ */
+rfm_status_t rf69_dev_dio0_isr(rf69_dev_t* dev)
+{
+#if RFM69_RX_RING_SIZE
+    rf69_packet_t* pkt;
+    rfm_reg_t res;
+#endif
+
+    /* PacketSent for an asynchronous transmission */
+    if (dev->mode == RFM69_MODE_TX && dev->tx_busy) {
+        dev->tx_done = true;
+        return RFM_OK;
+    }
+
+#if RFM69_RX_RING_SIZE
+    if (dev->mode != RFM69_MODE_RX && !dev->listening)
+        return RFM_FAIL;
+
+    if ((uint8_t)(dev->rx_head - dev->rx_tail) < RFM69_RX_RING_SIZE) {
+        pkt = &dev->rx_ring[dev->rx_head & (RFM69_RX_RING_SIZE - 1)];
+        _rf69_read(dev, RFM69_REG_24_RSSI_VALUE, &res);
+        pkt->rssi = -(res/2);
+        _rf69_fifo_read(dev, pkt->data, &pkt->len, RFM69_FIFO_SIZE);
+        dev->rx_head++;
+    }
+
+    /* Clear the radio FIFO, also discarding the packet if there was no
+     * room for it */
+    if (dev->listening)
+        _rf69_listen_resume(dev);
+    else
+        _rf69_clear_fifo(dev);
+
+    return RFM_OK;
+#else
+    return RFM_FAIL;
+#endif
+}
+
+#if RFM69_RX_RING_SIZE
+/**
+ * Get a packet received by rf69_dio0_isr(). Does not access the RFM69 so is
+ * safe to call at any time.
+ * @param dev The radio to use
+ * @param buf A pointer into the local buffer in which we would like the data.
+ * Must be at least RFM69_FIFO_SIZE bytes long.
+ * @param len The length of the data plus one, as for rf69_receive()
+ * @param lastrssi The RSSI of the packet we're getting
+ * @param rfm_packet_waiting A boolean pointer which is true if a packet was
+ * taken from the ring and put into the buffer buf, false if the ring was
+ * empty.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_receive_pop(rf69_dev_t* dev, rfm_reg_t* buf,
+        rfm_reg_t* len, int16_t* lastrssi, bool* rfm_packet_waiting)
+{
+    const rf69_packet_t* pkt;
+    uint8_t i;
+
+    if (dev->rx_head == dev->rx_tail) {
+        *rfm_packet_waiting = false;
+        return RFM_OK;
+    }
+
+    pkt = &dev->rx_ring[dev->rx_tail & (RFM69_RX_RING_SIZE - 1)];
+    for (i = 0; i < pkt->len; i++)
+        buf[i] = pkt->data[i];
+    *len = pkt->len + 1;
+    *lastrssi = pkt->rssi;
+
+    /* Only now hand the slot back to the ISR */
+    dev->rx_tail++;
+
+    *rfm_packet_waiting = true;
+    return RFM_OK;
+}
+#endif
+
+/**
+ * Check for a received packet and hand it straight to the caller, so no
+ * RFM69_FIFO_SIZE buffer or copy is needed. The payload is read from the FIFO
+ * directly into the buffer returned by sink.
+ * @param dev The radio to use
+ * @param sink Called with the packet length and RSSI, returns where to put
+ * the payload
+ * @param ctx Passed through to sink
+ * @param rfm_packet_waiting A boolean pointer which is true if a packet was
+ * handed to the sink, false if there was none or the sink dropped it.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_receive_sink(rf69_dev_t* dev, rf69_sink_t sink, void* ctx,
+        bool* rfm_packet_waiting)
+{
+    rfm_reg_t res, out, len;
+    rfm_reg_t* dest;
+    int16_t rssi;
+
+    *rfm_packet_waiting = false;
+
+    /* Don't cut short an asynchronous transmission */
+    if (dev->tx_busy)
+        return RFM_OK;
+
+    /* Only accept what the FIFO can hold in one go */
+    _rf69_rx_fifo_reset(dev);
+
+    /* In Listen mode the radio wakes up to receive by itself */
+    if (dev->mode != RFM69_MODE_RX && !dev->listening)
+        _rf69_set_mode(dev, RFM69_MODE_RX);
+
+    _rf69_read(dev, RFM69_REG_28_IRQ_FLAGS2, &res);
+    if (!(res & RF_IRQFLAGS2_PAYLOADREADY))
+        return RFM_OK;
+
+    /* The sink wants the RSSI before the payload */
+    _rf69_read(dev, RFM69_REG_24_RSSI_VALUE, &res);
+    rssi = -(res/2);
+
+    /* Length byte, then let the sink say where the payload goes without
+     * ending the transaction */
+    out = RFM69_REG_00_FIFO & ~RFM69_SPI_WRITE_MASK;
+    _rf69_select(dev);
+    _rf69_transfer(dev, &out, NULL, 1);
+    _rf69_transfer(dev, NULL, &len, 1);
+    if (len > RFM69_FIFO_SIZE)
+        len = RFM69_FIFO_SIZE;
+    dest = sink(ctx, len, rssi);
+    if (dest)
+        _rf69_transfer(dev, NULL, dest, len);
+    _rf69_deselect(dev);
+
+    /* Clear the radio FIFO, also throws away a dropped packet, or go back
+     * to listening, which clears it on the next wake up */
+    if (dev->listening)
+        _rf69_listen_resume(dev);
+    else
+        _rf69_clear_fifo(dev);
+
+    *rfm_packet_waiting = dest != NULL;
+    return RFM_OK;
+}
+
+/**
+ * Receive a packet of up to 255 bytes by draining the FIFO while the frame is
+ * still arriving. Must be called at least once every
+ * RFM69_FIFO_SIZE - RFM69_FIFO_STREAM_LEVEL octets of air time while a frame
+ * is in progress. The last octet is left in the FIFO until PayloadReady, so
+ * that reading it re-arms the receiver straight away instead of bouncing
+ * through standby as rf69_receive() does.
+ * @param dev The radio to use
+ * @param buf A pointer into the local buffer in which we would like the data.
+ * Must stay the same while a frame is in progress.
+ * @param maxlen The size of buf. Longer frames are dropped by the RFM69.
+ * @param len The number of payload bytes written to buf. Unlike
+ * rf69_receive() this does not count the length byte.
+ * @param lastrssi The RSSI of the packet we're getting
+ * @param rfm_packet_waiting A boolean pointer which is true if a whole packet
+ * is now in buf, false otherwise.
+ * @note With AES on, frames can't be longer than RFM69_AES_MAX_LEN (plus an
+ * address byte) and are only read once complete.
+ * @note Streaming sets RegPayloadLength to maxlen and the FIFO threshold to
+ * RFM69_FIFO_STREAM_LEVEL and leaves them there between frames.
+ * rf69_receive(), rf69_receive_sink() and rf69_listen_start() put both back
+ * and abandon any frame the stream was part way through.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_receive_stream(rf69_dev_t* dev, rfm_reg_t* buf,
+        const uint8_t maxlen, uint8_t* len, int16_t* lastrssi,
+        bool* rfm_packet_waiting)
+{
+    rfm_reg_t flags[2], out, res;
+    uint8_t chunk;
+
+    *rfm_packet_waiting = false;
+
+    /* Don't cut short an asynchronous transmission */
+    if (dev->tx_busy)
+        return RFM_OK;
+
+    if (!dev->rxs_active) {
+        _rf69_write_cached(dev, RFM69_REG_38_PAYLOAD_LENGTH, maxlen);
+        _rf69_modify(dev, RFM69_REG_3C_FIFO_THRESHOLD, 0x7F,
+                RFM69_FIFO_STREAM_LEVEL);
+    }
+
+    /* In Listen mode the radio wakes up to receive by itself */
+    if (dev->mode != RFM69_MODE_RX && !dev->listening) {
+        dev->rxs_active = false;
+        _rf69_set_mode(dev, RFM69_MODE_RX);
+    }
+
+    /* IRQ_FLAGS1 and IRQ_FLAGS2 in one transaction */
+    if (_rf69_burst_read(dev, RFM69_REG_27_IRQ_FLAGS1, flags, 2) != RFM_OK)
+        return RFM_FAIL;
+
+    /* With AES the FIFO only holds plain text once PayloadReady is set */
+    if (_rf69_aes_on(dev))
+        flags[1] &= ~RF_IRQFLAGS2_FIFOLEVEL;
+
+    if (!dev->rxs_active) {
+        if (!(flags[1] & (RF_IRQFLAGS2_PAYLOADREADY | RF_IRQFLAGS2_FIFOLEVEL)))
+            return RFM_OK;
+
+        /* The signal is still there while the frame is arriving */
+        _rf69_read(dev, RFM69_REG_24_RSSI_VALUE, &res);
+        dev->rxs_rssi = -(res/2);
+
+        /* Get the length byte, then as much of the payload as we know has
+         * arrived in the same transaction */
+        out = RFM69_REG_00_FIFO & ~RFM69_SPI_WRITE_MASK;
+        _rf69_select(dev);
+        _rf69_transfer(dev, &out, NULL, 1);
+        _rf69_transfer(dev, NULL, &dev->rxs_len, 1);
+        if (dev->rxs_len > maxlen)
+            dev->rxs_len = maxlen;
+        if (flags[1] & RF_IRQFLAGS2_PAYLOADREADY)
+            chunk = dev->rxs_len;
+        else if (dev->rxs_len > 1)
+            chunk = dev->rxs_len - 1 < RFM69_FIFO_STREAM_LEVEL - 1
+                ? dev->rxs_len - 1 : RFM69_FIFO_STREAM_LEVEL - 1;
+        else
+            chunk = 0;
+        _rf69_transfer(dev, NULL, buf, chunk);
+        _rf69_deselect(dev);
+
+        dev->rxs_got = chunk;
+        dev->rxs_active = true;
+    } else if (flags[1] & RF_IRQFLAGS2_PAYLOADREADY) {
+        /* All that's left is in the FIFO, reading the last octet empties it
+         * and AutoRxRestart re-arms the receiver */
+        _rf69_fifo_drain(dev, buf + dev->rxs_got, dev->rxs_len - dev->rxs_got);
+        dev->rxs_got = dev->rxs_len;
+    } else if (!(flags[0] & RF_IRQFLAGS1_SYNCADDRESSMATCH)) {
+        /* Bad CRC or a restart, the chip has thrown the frame away */
+        dev->rxs_active = false;
+        return RFM_OK;
+    } else if ((flags[1] & RF_IRQFLAGS2_FIFOLEVEL)
+            && dev->rxs_len - dev->rxs_got > 1) {
+        /* More than the threshold is waiting, take that much but never the
+         * last octet before PayloadReady */
+        chunk = dev->rxs_len - dev->rxs_got - 1;
+        if (chunk > RFM69_FIFO_STREAM_LEVEL)
+            chunk = RFM69_FIFO_STREAM_LEVEL;
+        _rf69_fifo_drain(dev, buf + dev->rxs_got, chunk);
+        dev->rxs_got += chunk;
+    }
+
+    if (!(flags[1] & RF_IRQFLAGS2_PAYLOADREADY))
+        return RFM_OK;
+
+    /* Listen mode has stopped at PayloadReady and is started again,
+     * otherwise without AutoRxRestart the receiver has to be re-armed by
+     * hand */
+    _rf69_read_cached(dev, RFM69_REG_3D_PACKET_CONFIG2, &res);
+    if (dev->listening)
+        _rf69_listen_resume(dev);
+    else if (!(res & RF_PACKET2_AUTORXRESTART_ON))
+        _rf69_rx_restart(dev);
+
+    dev->rxs_active = false;
+    *len = dev->rxs_len;
+    *lastrssi = dev->rxs_rssi;
+    *rfm_packet_waiting = true;
+    return RFM_OK;
+}
+
+/**
+ * Send a packet using the RFM69 radio and wait for it to go out. This is
+ * rf69_send_start() followed by rf69_send_poll() until the packet is sent.
+ * If it hasn't gone out RFM69_TIMEOUT_MS after its air time, the
+ * transmission is abandoned and the radio returned to its previous mode.
+ * While address filtering is on, the packet goes to the broadcast address.
+ * @param dev The radio to use
+ * @param data The data buffer that contains the string to transmit
+ * @param len The number of bytes in the data packet (excluding preamble, sync
+ * and checksum), up to RFM69_MAX_MESSAGE_LEN
+ * @param power The transmit power to be used in dBm
+ * @returns RFM_OK for success, RFM_FAIL for failure, RFM_TIMEOUT if the
+ * radio never signalled PacketSent or rf69_set_csma() found the channel busy
+ * too often.
+ */
+rfm_status_t rf69_dev_send(rf69_dev_t* dev, const rfm_reg_t* data, uint8_t len, 
+        const uint8_t power)
+{
+    rfm_reg_t addr;
+
+    return _rf69_send(dev, _rf69_tx_addr(dev, &addr), data, len, power);
+}
+
+/**
+ * Send a packet to one node and wait for it to go out, as rf69_send(). The
+ * address byte goes out in front of the data, so that receivers with address
+ * filtering on drop the packet without waking their host.
+ * @param dev The radio to use
+ * @param addr The node address (or broadcast address) to send to
+ * @param data The data buffer that contains the string to transmit
+ * @param len The number of bytes in the data packet (excluding the address
+ * byte), up to RFM69_MAX_MESSAGE_LEN - 1
+ * @param power The transmit power to be used in dBm
+ * @returns RFM_OK for success, RFM_FAIL for failure, RFM_TIMEOUT if the
+ * radio never signalled PacketSent or rf69_set_csma() found the channel busy
+ * too often.
+ */
+rfm_status_t rf69_dev_send_to(rf69_dev_t* dev, const rfm_reg_t addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power)
+{
+    return _rf69_send(dev, &addr, data, len, power);
+}
+
+/**
+ * Send a packet and wait for it to go out, for rf69_send() and
+ * rf69_send_to().
+ * @param addr The address byte to send in front of the data, or NULL for none
+ * @returns RFM_OK for success, RFM_FAIL for failure, RFM_TIMEOUT if the
+ * radio never signalled PacketSent or the channel stayed busy.
+ */
+static rfm_status_t _rf69_send(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power)
+{
+    rfm_status_t status;
+    uint32_t deadline;
+    bool done;
+
+    status = _rf69_send_start(dev, addr, data, len, power);
+
+    /* Sit out any backoff without touching the bus */
+    while (status == RFM_BUSY)
+        status = _rf69_tx_backoff(dev);
+    if (status != RFM_OK)
+        return status;
+
+    deadline = _rf69_millis(dev) + _rf69_air_ms(dev, addr ? len + 1 : len)
+        + RFM69_TIMEOUT_MS;
+
+    for (;;) {
+        if (rf69_dev_send_poll(dev, &done) != RFM_OK)
+            return RFM_FAIL;
+        if (done)
+            return RFM_OK;
+        if (_rf69_expired(dev, deadline)) {
+            _rf69_tx_finish(dev);
+            return RFM_TIMEOUT;
+        }
+    }
+}
+
+/**
+ * Start sending a packet and return without waiting for it to go out. The
+ * packet is loaded into the FIFO in STDBY and the radio put into TX mode;
+ * transmission begins by itself once the PA has ramped up. DIO0 is mapped to
+ * PacketSent until the transmission completes. While address filtering is
+ * on, the packet goes to the broadcast address. With rf69_set_csma() on,
+ * the RSSI is read first. If the channel is busy, this returns RFM_BUSY
+ * without loading the packet, and rf69_send_poll() starts it once a backoff
+ * ends with the channel clear.
+ *
+ * Packets longer than RFM69_FIFO_SIZE are streamed: the first
+ * RFM69_FIFO_SIZE bytes are loaded here and rf69_send_poll() tops up the
+ * FIFO whenever it drains to the FifoLevel threshold in
+ * RFM69_REG_3C_FIFO_THRESHOLD. rf69_send_poll() must then be called at
+ * least once every threshold bytes of air time.
+ * @param dev The radio to use
+ * @param data The data buffer that contains the string to transmit. Packets
+ * of up to RFM69_FIFO_SIZE bytes are copied into the FIFO before this
+ * function returns RFM_OK, longer ones or ones held back with RFM_BUSY must
+ * remain valid until the send completes.
+ * @param len The number of bytes in the data packet (excluding preamble, sync
+ * and checksum), up to RFM69_MAX_MESSAGE_LEN
+ * @param power The transmit power to be used in dBm
+ * @returns RFM_OK for success, RFM_BUSY if the send is backing off from a
+ * busy channel, RFM_FAIL for failure or if a transmission is already in
+ * progress, RFM_TIMEOUT if rf69_set_csma() found the channel busy too often.
+ */
+rfm_status_t rf69_dev_send_start(rf69_dev_t* dev, const rfm_reg_t* data,
+        uint8_t len, const uint8_t power)
+{
+    rfm_reg_t addr;
+
+    return _rf69_send_start(dev, _rf69_tx_addr(dev, &addr), data, len, power);
+}
+
+/**
+ * Start sending a packet to one node, as rf69_send_start(). The address
+ * byte goes out in front of the data.
+ * @param dev The radio to use
+ * @param addr The node address (or broadcast address) to send to
+ * @param data The data buffer that contains the string to transmit
+ * @param len The number of bytes in the data packet (excluding the address
+ * byte), up to RFM69_MAX_MESSAGE_LEN - 1
+ * @param power The transmit power to be used in dBm
+ * @returns RFM_OK for success, RFM_BUSY if the send is backing off from a
+ * busy channel, RFM_FAIL for failure or if a transmission is already in
+ * progress, RFM_TIMEOUT if rf69_set_csma() found the channel busy too often.
+ */
+rfm_status_t rf69_dev_send_start_to(rf69_dev_t* dev, const rfm_reg_t addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power)
+{
+    return _rf69_send_start(dev, &addr, data, len, power);
+}
+
+/**
+ * Start sending a packet, for rf69_send_start() and rf69_send_start_to().
+ * @param addr The address byte to send in front of the data, or NULL for none
+ * @returns RFM_OK for success, RFM_BUSY if the send is backing off, RFM_FAIL
+ * for failure or if a transmission is already in progress, RFM_TIMEOUT if
+ * the channel stayed busy.
+ */
+static rfm_status_t _rf69_send_start(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power)
+{
+    rfm_status_t status;
+    uint16_t total;
+
+    /* power is TX Power in dBmW (valid values are 2dBmW-20dBmW) */
+    if (power < 2 || power > 20)
+    {
+        /* Could be dangerous, so let's check this */
+        return RFM_FAIL;
+    }
+
+    if (dev->tx_busy)
+        return RFM_FAIL;
+
+    /* The length byte counts the address byte too */
+    total = addr ? (uint16_t)len + 1 : len;
+    if (total > 255 || total > RFM69_MAX_MESSAGE_LEN)
+        return RFM_FAIL;
+
+    /* The AES engine encrypts the FIFO as a whole before sending, and
+     * leaves an address byte in the clear */
+    if (_rf69_aes_on(dev)
+            && total > (addr ? RFM69_AES_MAX_LEN + 1 : RFM69_AES_MAX_LEN))
+        return RFM_FAIL;
+
+    dev->tx_old_mode = dev->mode;
+    dev->tx_listen = dev->listening;
+
+    /* Listen before talk */
+    dev->csma_tries = 0;
+    status = _rf69_csma(dev, total);
+    if (status == RFM_BUSY) {
+        /* Hold the packet back for rf69_send_poll() */
+        dev->tx_to = addr != NULL;
+        if (addr)
+            dev->tx_addr = *addr;
+        dev->tx_src = data;
+        dev->tx_left = len;
+        dev->tx_power = power;
+        dev->tx_backoff = true;
+        dev->tx_busy = true;
+        return RFM_BUSY;
+    }
+    if (status != RFM_OK) {
+        _rf69_mode_restore(dev, dev->tx_old_mode, dev->tx_listen);
+        return status;
+    }
+
+    return _rf69_tx_load(dev, addr, data, len, power);
+}
+
+/**
+ * Load a packet into the FIFO and put the radio into TX, once the channel
+ * has been found clear.
+ * @param addr The address byte to send in front of the data, or NULL for none
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_tx_load(rf69_dev_t* dev, const rfm_reg_t* addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power)
+{
+    uint8_t chunk;
+
+    /* Load the FIFO in STDBY, entering TX from RX would clear it. In FS
+     * the PLL is already locked, so TX starts sooner from there. Listen
+     * mode is left first: a wake up would clear the FIFO, and would run the
+     * receiver with the high power PA settings on. */
+    if (dev->listening
+            || (dev->mode != RFM69_MODE_STDBY && dev->mode != RFM69_MODE_FS))
+        _rf69_set_mode(dev, RFM69_MODE_STDBY);
+
+    /* Set up PA */
+    _rf69_pa_setup(dev, power);
+
+    /* Signal PacketSent rather than TxReady on DIO0 */
+    _rf69_modify(dev, RFM69_REG_25_DIO_MAPPING1, 0xC0, RF_DIOMAPPING1_DIO0_00);
+
+    /* Throw Buffer into FIFO, or as much of it as fits */
+    chunk = len > RFM69_FIFO_SIZE ? RFM69_FIFO_SIZE : len;
+    _rf69_fifo_write(dev, addr, data, len, chunk);
+    dev->tx_src = data + chunk;
+    dev->tx_left = len - chunk;
+
+    dev->tx_done = false;
+    dev->tx_busy = true;
+
+    /* Start transmitter, packet transmission will start automatically
+     * after PA ramp-up */
+    _rf69_set_mode(dev, RFM69_MODE_TX);
+
+    return RFM_OK;
+}
+
+/**
+ * Carry on with a send held back by a busy channel. Nothing is read from the
+ * radio until the backoff is over, then the RSSI is sampled once and the
+ * packet either started or held back for another backoff.
+ * @returns RFM_OK once the transmission has started, RFM_BUSY while still
+ * backing off, RFM_FAIL for failure, RFM_TIMEOUT if the channel stayed busy,
+ * in which case the packet is dropped.
+ */
+static rfm_status_t _rf69_tx_backoff(rf69_dev_t* dev)
+{
+    rfm_status_t status;
+    uint8_t len = dev->tx_left;
+
+    if (!_rf69_expired(dev, dev->csma_until))
+        return RFM_BUSY;
+
+    status = _rf69_csma(dev, dev->tx_to ? (uint16_t)len + 1 : len);
+    if (status == RFM_BUSY)
+        return status;
+
+    dev->tx_backoff = false;
+    dev->tx_busy = false;
+    if (status != RFM_OK) {
+        dev->tx_left = 0;
+        _rf69_mode_restore(dev, dev->tx_old_mode, dev->tx_listen);
+        return status;
+    }
+
+    return _rf69_tx_load(dev, dev->tx_to ? &dev->tx_addr : NULL,
+            dev->tx_src, len, dev->tx_power);
+}
+
+/**
+ * Check whether a transmission started by rf69_send_start() has finished.
+ * When it has, the radio is returned to the mode it was in beforehand and
+ * the PA, OCP and DIO0 mapping are restored. If rf69_dio0_isr() has already
+ * seen PacketSent, IRQ_FLAGS2 is not read. While a long packet is still
+ * being streamed, this tops up the FIFO. While the send is backing off from a
+ * busy channel, this starts it once the backoff is over and the channel is
+ * clear.
+ * @param dev The radio to use
+ * @param done A pointer to a bool that is set true if no transmission is
+ * in progress any more, false otherwise
+ * @returns RFM_OK for success, RFM_FAIL for failure, RFM_TIMEOUT if
+ * rf69_set_csma() found the channel busy too often and dropped the packet.
+ */
+rfm_status_t rf69_dev_send_poll(rf69_dev_t* dev, bool* done)
+{
+    rfm_status_t status;
+    rfm_reg_t res;
+
+    if (!dev->tx_busy) {
+        *done = true;
+        return RFM_OK;
+    }
+
+    if (dev->tx_backoff) {
+        status = _rf69_tx_backoff(dev);
+        *done = status != RFM_OK && status != RFM_BUSY;
+        return status == RFM_BUSY ? RFM_OK : status;
+    }
+
+    /* Still streaming, PacketSent can't have happened yet */
+    if (dev->tx_left) {
+        *done = false;
+        return _rf69_tx_refill(dev);
+    }
+
+    if (!dev->tx_done) {
+        if (_rf69_read(dev, RFM69_REG_28_IRQ_FLAGS2, &res) != RFM_OK)
+            return RFM_FAIL;
+        if (res & RF_IRQFLAGS2_PACKETSENT)
+            dev->tx_done = true;
+    }
+
+    if (!dev->tx_done) {
+        *done = false;
+        return RFM_OK;
+    }
+
+    *done = true;
+    return _rf69_tx_finish(dev);
+}
+
+/**
+ * End a transmission started by rf69_send_start(), whether or not the packet
+ * has gone out, and put the radio back the way it was beforehand, listening
+ * again if it was.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_tx_finish(rf69_dev_t* dev)
+{
+    /* Return Transceiver to original mode, this switches off the High
+     * Power Registers if we are going back to RX or Listen mode */
+    _rf69_mode_restore(dev, dev->tx_old_mode, dev->tx_listen);
+
+    /* DIO0 back to PayloadReady / TxReady */
+    _rf69_modify(dev, RFM69_REG_25_DIO_MAPPING1, 0xC0, RF_DIOMAPPING1_DIO0_01);
+
+    dev->tx_left = 0;
+    dev->tx_busy = false;
+
+    return RFM_OK;
+}
+
+/**
+ * Load the next part of a long packet into the FIFO if it has drained to the
+ * FifoLevel threshold.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_tx_refill(rf69_dev_t* dev)
+{
+    rfm_reg_t res, thresh;
+    uint8_t chunk;
+
+    if (_rf69_read(dev, RFM69_REG_28_IRQ_FLAGS2, &res) != RFM_OK)
+        return RFM_FAIL;
+
+    /* FifoLevel is set while the FIFO holds more than the threshold */
+    if (res & RF_IRQFLAGS2_FIFOLEVEL)
+        return RFM_OK;
+
+    /* So there is room for at least RFM69_FIFO_SIZE - threshold bytes */
+    _rf69_read_cached(dev, RFM69_REG_3C_FIFO_THRESHOLD, &thresh);
+    chunk = RFM69_FIFO_SIZE - (thresh & 0x7F);
+    if (chunk > dev->tx_left)
+        chunk = dev->tx_left;
+
+    if (_rf69_fifo_append(dev, dev->tx_src, chunk) != RFM_OK)
+        return RFM_FAIL;
+    dev->tx_src += chunk;
+    dev->tx_left -= chunk;
+
+    return RFM_OK;
+}
+
+#if RFM69_TX_QUEUE_SIZE
+/**
+ * Add a packet to the transmit queue. Nothing is sent until rf69_tx_flush().
+ * @warning Only a pointer to the data is kept, the buffer must remain valid
+ * until rf69_tx_flush() returns.
+ * @param dev The radio to use
+ * @param data The data buffer that contains the string to transmit
+ * @param len The number of bytes in the data packet (excluding preamble, sync
+ * and checksum), up to RFM69_FIFO_SIZE
+ * @returns RFM_OK for success, RFM_FAIL if the queue is full or the packet
+ * is too long.
+ */
+rfm_status_t rf69_dev_tx_queue(rf69_dev_t* dev, const rfm_reg_t* data,
+        uint8_t len)
+{
+    if (dev->txq_count == RFM69_TX_QUEUE_SIZE || len > RFM69_FIFO_SIZE)
+        return RFM_FAIL;
+
+    dev->txq_data[dev->txq_count] = data;
+    dev->txq_len[dev->txq_count] = len;
+    dev->txq_count++;
+
+    return RFM_OK;
+}
+
+/**
+ * Send every packet in the transmit queue back to back. The PA is set up
+ * once for the whole batch, and between packets the radio waits in FS mode
+ * (which clears PacketSent and the FIFO but keeps the PLL locked) rather
+ * than returning to its previous mode. That mode is restored once the queue
+ * has drained. While address filtering is on, the packets go to the
+ * broadcast address. With rf69_set_csma() on, the channel is checked once
+ * before the first packet.
+ * @param dev The radio to use
+ * @param power The transmit power to be used in dBm
+ * @returns RFM_OK for success, RFM_FAIL for failure or if an asynchronous
+ * transmission is in progress, RFM_TIMEOUT if a packet hadn't gone out
+ * RFM69_TIMEOUT_MS after its air time, in which case the rest are dropped,
+ * or if rf69_set_csma() found the channel busy too often. The queue is
+ * emptied either way.
+ */
+rfm_status_t rf69_dev_tx_flush(rf69_dev_t* dev, const uint8_t power)
+{
+    const rfm_reg_t* addr;
+    rfm_reg_t oldMode, bcast;
+    rfm_status_t status;
+    uint32_t deadline;
+    bool listen;
+    uint8_t i;
+
+    if (!dev->txq_count)
+        return RFM_OK;
+
+    /* power is TX Power in dBmW (valid values are 2dBmW-20dBmW) */
+    if (power < 2 || power > 20 || dev->tx_busy)
+    {
+        dev->txq_count = 0;
+        return RFM_FAIL;
+    }
+
+    oldMode = dev->mode;
+    listen = dev->listening;
+    addr = _rf69_tx_addr(dev, &bcast);
+
+    /* Listen before talk, once for the whole batch, sitting out any backoff
+     * without touching the bus */
+    dev->csma_tries = 0;
+    while ((status = _rf69_csma(dev,
+                    addr ? dev->txq_len[0] + 1 : dev->txq_len[0])) == RFM_BUSY)
+        while (!_rf69_expired(dev, dev->csma_until))
+            ;
+    if (status != RFM_OK) {
+        dev->txq_count = 0;
+        _rf69_mode_restore(dev, oldMode, listen);
+        return status;
+    }
+
+    /* Load the first packet in STDBY (or FS), entering TX from RX would
+     * clear it. Listen mode is left first, as in rf69_send_start(). */
+    if (dev->listening
+            || (dev->mode != RFM69_MODE_STDBY && dev->mode != RFM69_MODE_FS))
+        _rf69_set_mode(dev, RFM69_MODE_STDBY);
+
+    /* Set up PA once for the whole batch */
+    _rf69_pa_setup(dev, power);
+
+    status = RFM_OK;
+    for (i = 0; i < dev->txq_count && status == RFM_OK; i++) {
+        _rf69_fifo_write(dev, addr, dev->txq_data[i], dev->txq_len[i],
+                dev->txq_len[i]);
+        deadline = _rf69_millis(dev) + _rf69_air_ms(dev,
+                addr ? dev->txq_len[i] + 1 : dev->txq_len[i])
+            + RFM69_TIMEOUT_MS;
+        _rf69_set_mode(dev, RFM69_MODE_TX);
+
+        /* Wait for packet to be sent */
+        status = _rf69_wait(dev, RFM69_REG_28_IRQ_FLAGS2,
+                RF_IRQFLAGS2_PACKETSENT, RF_IRQFLAGS2_PACKETSENT, deadline);
+
+        /* Park in FS, ready to ramp straight back up */
+        if (i + 1 < dev->txq_count)
+            _rf69_set_mode(dev, RFM69_MODE_FS);
+    }
+    dev->txq_count = 0;
+
+    /* Return Transceiver to original mode, this switches off the High
+     * Power Registers if we are going back to RX or Listen mode */
+    _rf69_mode_restore(dev, oldMode, listen);
+
+    return status;
+}
+#endif
+
+/**
+ * Configure the PA for a transmission, writing only the registers whose
+ * value changes. Above 17dBm this disables OCP and engages the high power
+ * registers; they are left engaged afterwards so that consecutive high
+ * power sends need no further writes, until rf69_set_mode() enters RX or a
+ * lower power is requested.
+ * @param power The transmit power to be used in dBm
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_pa_setup(rf69_dev_t* dev, const uint8_t power)
+{
+    uint8_t paLevel;
+
+    if (_rf69_pa_boost(dev, power > 17) != RFM_OK)
+        return RFM_FAIL;
+
+    if (power <= 17) {
+        /* Set PA Level */
+        paLevel = power + 28;
+        return _rf69_write_cached(dev, RFM69_REG_11_PA_LEVEL, RF_PALEVEL_PA0_ON | RF_PALEVEL_PA1_OFF | RF_PALEVEL_PA2_OFF | paLevel);        
+    } else {
+        /* Set PA Level */
+        paLevel = power + 11;
+        return _rf69_write_cached(dev, RFM69_REG_11_PA_LEVEL, RF_PALEVEL_PA0_OFF | RF_PALEVEL_PA1_ON | RF_PALEVEL_PA2_ON | paLevel);
+    }
+}
+
+/**
+ * Engage or disengage the high power PA registers (+20dBm, section 3.3.7 in
+ * the datasheet). OCP is switched off while they are engaged. Does nothing
+ * if they are already in the requested state.
+ * @warning The high power registers must be disengaged in RX mode.
+ * @param on True to engage the high power registers, false to disengage
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_pa_boost(rf69_dev_t* dev, const bool on)
+{
+    if (on == dev->pa_boost)
+        return RFM_OK;
+
+    if (on) {
+        /* Disable Over Current Protection */
+        _rf69_write_cached(dev, RFM69_REG_13_OCP, RF_OCP_OFF);
+        /* Enable High Power Registers */
+        _rf69_write(dev, RFM69_REG_5A_TEST_PA1, 0x5D);
+        _rf69_write(dev, RFM69_REG_5C_TEST_PA2, 0x7C);
+    } else {
+        /* Disable High Power Registers */
+        _rf69_write(dev, RFM69_REG_5A_TEST_PA1, 0x55);
+        _rf69_write(dev, RFM69_REG_5C_TEST_PA2, 0x70);
+        /* Enable Over Current Protection */
+        _rf69_write_cached(dev, RFM69_REG_13_OCP, RF_OCP_ON | RF_OCP_TRIM_95);
+    }
+    dev->pa_boost = on;
+
+    return RFM_OK;
+}
+
+/**
+ * Clear the FIFO in the RFM69. We do this by entering STBY mode and then
+ * returing to RX mode.
+ * @warning Must only be called in RX Mode
+ * @note Apparently this works... found in HopeRF demo code
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_clear_fifo(rf69_dev_t* dev)
+{
+    _rf69_set_mode(dev, RFM69_MODE_STDBY);
+    _rf69_set_mode(dev, RFM69_MODE_RX);
+    return RFM_OK;
+}
+
+/**
+ * Put back the packet length limit and FIFO threshold that
+ * rf69_receive_stream() changes, ending any frame it was part way through.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_rx_fifo_reset(rf69_dev_t* dev)
+{
+    dev->rxs_active = false;
+
+    if (_rf69_write_cached(dev, RFM69_REG_38_PAYLOAD_LENGTH,
+                RFM69_FIFO_SIZE) != RFM_OK)
+        return RFM_FAIL;
+
+    return _rf69_write_cached(dev, RFM69_REG_3C_FIFO_THRESHOLD,
+            CONFIG[_rf69_shadow_index(RFM69_REG_3C_FIFO_THRESHOLD)][1]);
+}
+
+/**
+ * The RFM69 has an onboard temperature sensor, read its value. This is
+ * rf69_temp_start() followed by rf69_temp_poll() until the conversion is
+ * done.
+ * @param dev The radio to use
+ * @param temperature A pointer to the variable into which the temperature will
+ * be read by this method.
+ * @returns RFM_OK for success, RFM_FAIL for failure or while listening,
+ * RFM_TIMEOUT if there is a timeout due to the sensor on the RFM not
+ * finishing a conversion within RFM69_TIMEOUT_MS.
+ */
+rfm_status_t rf69_dev_read_temp(rf69_dev_t* dev, int8_t* temperature)
+{
+    rfm_status_t res;
+    bool done;
+
+    if (rf69_dev_temp_start(dev) != RFM_OK)
+        return RFM_FAIL;
+
+    do {
+        res = rf69_dev_temp_poll(dev, &done, temperature);
+    } while (res == RFM_OK && !done);
+
+    if (res != RFM_OK)
+        *temperature = -127;
+    return res;
+}
+
+/**
+ * Start a temperature conversion and return without waiting for it. The
+ * sensor only runs in STDBY or FS; from any other mode the radio is put in
+ * STDBY and rf69_temp_poll() returns it to that mode once the conversion is
+ * done, about 100us later. Not while listening, as the next Rx period
+ * would cut the conversion short; use rf69_listen_stop() first.
+ * @param dev The radio to use
+ * @returns RFM_OK for success, RFM_FAIL for failure, if a transmission is
+ * in progress or while listening.
+ */
+rfm_status_t rf69_dev_temp_start(rf69_dev_t* dev)
+{
+    if (dev->tx_busy || dev->listening)
+        return RFM_FAIL;
+
+    if (!RFM69_TEMP_MODE(dev->mode)) {
+        dev->temp_old_mode = dev->mode;
+        _rf69_set_mode(dev, RFM69_MODE_STDBY);
+        dev->temp_restore = true;
+    } else if (!dev->temp_running) {
+        dev->temp_restore = false;
+    }
+
+    /* Entering STDBY may already have started one */
+    if (!dev->temp_running)
+        return _rf69_temp_trigger(dev);
+    return RFM_OK;
+}
+
+/**
+ * Check whether a conversion started by rf69_temp_start() has finished. When
+ * it has, the reading is cached and the radio is returned to the mode it was
+ * in beforehand.
+ * @param dev The radio to use
+ * @param done A pointer to a bool that is set true once the conversion has
+ * finished, false otherwise
+ * @param temperature Where to put the temperature in degrees C once done
+ * @returns RFM_OK for success, RFM_FAIL for failure or if there is no
+ * reading, RFM_TIMEOUT if the conversion didn't finish within
+ * RFM69_TIMEOUT_MS, in which case it is abandoned.
+ */
+rfm_status_t rf69_dev_temp_poll(rf69_dev_t* dev, bool* done,
+        int8_t* temperature)
+{
+    rfm_status_t res;
+
+    res = RFM_OK;
+    if (dev->temp_running) {
+        if (_rf69_temp_collect(dev, done) != RFM_OK)
+            return RFM_FAIL;
+        if (!*done && !_rf69_expired(dev, dev->temp_deadline))
+            return RFM_OK;
+        if (!*done)
+            res = RFM_TIMEOUT;
+        dev->temp_running = false;
+
+        /* Set transceiver back to original mode */
+        if (dev->temp_restore)
+            _rf69_set_mode(dev, dev->temp_old_mode);
+    }
+
+    *done = true;
+    if (res == RFM_OK)
+        res = dev->temp_valid ? RFM_OK : RFM_FAIL;
+    *temperature = dev->temp;
+    return res;
+}
+
+/**
+ * Get the last temperature reading without touching the radio. It is
+ * refreshed by rf69_temp_start() and rf69_read_temp(), and whenever the
+ * library puts the radio in STDBY or FS (see RFM69_TEMP_REFRESH_MS).
+ * @param dev The radio to use
+ * @param temperature Where to put the temperature in degrees C
+ * @param age_ms Where to put how long ago it was measured, may be NULL
+ * @returns RFM_OK for success, RFM_FAIL if there has been no reading yet.
+ */
+rfm_status_t rf69_dev_temp_cached(rf69_dev_t* dev, int8_t* temperature,
+        uint32_t* age_ms)
+{
+    if (!dev->temp_valid)
+        return RFM_FAIL;
+
+    *temperature = dev->temp;
+    if (age_ms)
+        *age_ms = _rf69_millis(dev) - dev->temp_ms;
+    return RFM_OK;
+}
+
+/**
+ * Trigger a temperature conversion, which must be done in STDBY or FS.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_temp_trigger(rf69_dev_t* dev)
+{
+    if (_rf69_write(dev, RFM69_REG_4E_TEMP1, RF_TEMP1_MEAS_START) != RFM_OK)
+        return RFM_FAIL;
+    dev->temp_running = true;
+    dev->temp_try_ms = _rf69_millis(dev);
+    dev->temp_deadline = dev->temp_try_ms + RFM69_TIMEOUT_MS;
+    return RFM_OK;
+}
+
+/**
+ * Read the temperature sensor status and result in one transaction, and
+ * cache the result if the conversion has finished.
+ * @param done A pointer to a bool that is set true if it has finished
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_temp_collect(rf69_dev_t* dev, bool* done)
+{
+    rfm_reg_t res[2];
+
+    if (_rf69_burst_read(dev, RFM69_REG_4E_TEMP1, res, 2) != RFM_OK)
+        return RFM_FAIL;
+
+    *done = !(res[0] & RF_TEMP1_MEAS_RUNNING);
+    if (*done) {
+        dev->temp = 161 - (int8_t)res[1];
+        dev->temp_ms = _rf69_millis(dev);
+        dev->temp_valid = true;
+        dev->temp_running = false;
+    }
+    return RFM_OK;
+}
+
+/**
+ * Stop waiting for a conversion that leaving STDBY or FS cuts short, keeping
+ * the result if it had already finished. One that hadn't isn't counted as
+ * an attempt, so the next refresh is due straight away.
+ */
+static void _rf69_temp_abandon(rf69_dev_t* dev)
+{
+    bool done = false;
+
+    _rf69_temp_collect(dev, &done);
+    dev->temp_running = false;
+#if RFM69_TEMP_REFRESH_MS
+    if (!done)
+        dev->temp_try_ms = _rf69_millis(dev) - RFM69_TEMP_REFRESH_MS;
+#endif
+}
+
+/**
+ * Get the last RSSI value from the RFM69
+ * @warning Must only be called when the RFM69 is in rx mode
+ * @param dev The radio to use
+ * @param rssi A pointer to an int16_t where we will place the RSSI value
+ * @returns RFM_OK for success, RFM_FAIL for failure, RFM_TIMEOUT if the
+ * measurement didn't complete within RFM69_TIMEOUT_MS.
+ */
+rfm_status_t rf69_dev_sample_rssi(rf69_dev_t* dev, int16_t* rssi)
+{
+    rfm_reg_t res;
+    rfm_status_t status;
+
+    /* Must only be called in RX mode */
+    if (dev->mode != RFM69_MODE_RX)
+        return RFM_FAIL;
+
+    /* Trigger RSSI Measurement */
+    _rf69_write(dev, RFM69_REG_23_RSSI_CONFIG, RF_RSSI_START);
+
+    /* Wait for Measurement to complete */
+    status = _rf69_wait(dev, RFM69_REG_23_RSSI_CONFIG, RF_RSSI_DONE,
+            RF_RSSI_DONE, _rf69_millis(dev) + RFM69_TIMEOUT_MS);
+    if (status != RFM_OK)
+        return status;
+
+    /* Read, store in _lastRssi and return RSSI Value */
+    res = 0;
+    _rf69_read(dev, RFM69_REG_24_RSSI_VALUE, &res);
+    *rssi = -(res/2);
+
+    return RFM_OK;
+}
+
+/**
+ * Put the RFM69 in Listen mode, where it wakes up by itself to receive for
+ * rx_us every idle_us, timed by its RC oscillator, which is calibrated first.
+ * The average current is roughly 16mA * rx_us / (idle_us + rx_us), e.g.
+ * about 16uA for 1ms in every second. When a packet arrives the radio stops
+ * listening and keeps it in the FIFO, signalling PayloadReady on DIO0 as
+ * usual. rf69_receive() and rf69_dio0_isr() collect it from there and
+ * start listening again. Any mode change ends Listen mode. Sends,
+ * rf69_tx_flush() and rf69_rssi_sweep() leave it for as long as they need
+ * the radio and then start listening again.
+ *
+ * A transmitter must keep the channel busy (e.g. with a long preamble, or by
+ * repeating the packet) for at least idle_us + rx_us to be sure of being
+ * heard.
+ * @param dev The radio to use
+ * @param idle_us Time to spend asleep in each cycle, in us, rounded to what
+ * the radio can do (64us steps up to 16ms, 4.1ms steps up to 1s, 262ms
+ * steps up to 66s)
+ * @param rx_us Time to listen for in each cycle, in us, rounded likewise
+ * @param criteria RF_LISTEN1_CRITERIA_RSSI to stay awake when the RSSI
+ * threshold is crossed, RF_LISTEN1_CRITERIA_RSSIANDSYNC to also require the
+ * sync word within the Rx period
+ * @returns RFM_OK for success, RFM_FAIL for failure, a time out of range or
+ * if a transmission is in progress, RFM_TIMEOUT if the RC oscillator
+ * calibration didn't finish within RFM69_TIMEOUT_MS.
+ */
+rfm_status_t rf69_dev_listen_start(rf69_dev_t* dev, const uint32_t idle_us,
+        const uint32_t rx_us, const rfm_reg_t criteria)
+{
+    rfm_reg_t listen[3];
+    rfm_status_t res;
+    uint8_t idle_resol, rx_resol;
+
+    if (dev->tx_busy)
+        return RFM_FAIL;
+
+    if (_rf69_listen_time(idle_us, &idle_resol, &listen[1]) != RFM_OK
+            || _rf69_listen_time(rx_us, &rx_resol, &listen[2]) != RFM_OK)
+        return RFM_FAIL;
+    listen[0] = idle_resol << 6 | rx_resol << 4
+        | (criteria & RF_LISTEN1_CRITERIA_RSSIANDSYNC) | RF_LISTEN1_END_01;
+
+    /* Listen mode is entered from STDBY, and wakes up straight into RX so
+     * the high power PA settings must be off */
+    _rf69_set_mode(dev, RFM69_MODE_STDBY);
+    if (_rf69_pa_boost(dev, false) != RFM_OK)
+        return RFM_FAIL;
+
+    /* Calibrate the RC oscillator that times the idle periods */
+    _rf69_write(dev, RFM69_REG_0A_OSC1, RF_OSC1_RCCAL_START);
+    res = _rf69_wait(dev, RFM69_REG_0A_OSC1, RF_OSC1_RCCAL_DONE,
+            RF_OSC1_RCCAL_DONE, _rf69_millis(dev) + RFM69_TIMEOUT_MS);
+    if (res != RFM_OK)
+        return res;
+
+    /* The first Rx period would cut a temperature conversion short */
+    if (dev->temp_running)
+        _rf69_temp_abandon(dev);
+
+    /* Only accept what the FIFO can hold in one go, as for rf69_receive() */
+    _rf69_rx_fifo_reset(dev);
+
+    if (_rf69_burst_write(dev, RFM69_REG_0D_LISTEN1, listen, 3) != RFM_OK)
+        return RFM_FAIL;
+    if (_rf69_modify(dev, RFM69_REG_01_OPMODE, RF_OPMODE_LISTEN_ON,
+                RF_OPMODE_LISTEN_ON) != RFM_OK)
+        return RFM_FAIL;
+    dev->listening = true;
+
+    return RFM_OK;
+}
+
+/**
+ * Leave Listen mode, putting the RFM69 in STDBY. Any packet that it woke up
+ * for and that hasn't been collected is kept in the FIFO. Does nothing if
+ * it isn't listening.
+ * @param dev The radio to use
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_listen_stop(rf69_dev_t* dev)
+{
+    if (!dev->listening)
+        return RFM_OK;
+    return rf69_dev_set_mode(dev, RFM69_MODE_STDBY);
+}
+
+/**
+ * Work out the RegListen1 resolution and the coefficient for a Listen mode
+ * period, using the finest resolution that can reach it.
+ * @param us The period in us
+ * @param resol Where to put the resolution, 1 to 3 for 64us, 4.1ms and 262ms
+ * @param coef Where to put the coefficient
+ * @returns RFM_OK for success, RFM_FAIL if the period is out of range.
+ */
+static rfm_status_t _rf69_listen_time(const uint32_t us, uint8_t* resol,
+        rfm_reg_t* coef)
+{
+    static const uint32_t resol_us[3] = { 64, 4100, 262000 };
+    uint32_t c;
+    uint8_t i;
+
+    if (!us || us > 255 * resol_us[2])
+        return RFM_FAIL;
+
+    for (i = 0; i < 3; i++) {
+        c = (us + resol_us[i] / 2) / resol_us[i];
+        if (c <= 255) {
+            *resol = i + 1;
+            *coef = c ? c : 1;
+            break;
+        }
+    }
+    return RFM_OK;
+}
+
+/**
+ * Start listening again after Listen mode has woken up for a packet, and
+ * stopped in STDBY. ListenOn has to be cleared with ListenAbort before it
+ * can be set again.
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_listen_resume(rf69_dev_t* dev)
+{
+    if (_rf69_modify(dev, RFM69_REG_01_OPMODE,
+                RF_OPMODE_LISTEN_ON | RF_OPMODE_LISTENABORT,
+                RF_OPMODE_LISTENABORT) != RFM_OK)
+        return RFM_FAIL;
+    if (_rf69_modify(dev, RFM69_REG_01_OPMODE, 0, 0) != RFM_OK)
+        return RFM_FAIL;
+    return _rf69_modify(dev, RFM69_REG_01_OPMODE, RF_OPMODE_LISTEN_ON,
+            RF_OPMODE_LISTEN_ON);
+}
+
+/**
+ * Put the radio back the way it was before the library took it over for a
+ * send or a sweep: in its old mode, or listening again with the settings
+ * from rf69_listen_start() if it was listening.
+ * @param oldMode The mode it was in
+ * @param listen Whether it was listening
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+static rfm_status_t _rf69_mode_restore(rf69_dev_t* dev,
+        const rfm_reg_t oldMode, const bool listen)
+{
+    if (!listen) {
+        if (dev->mode != oldMode)
+            return rf69_dev_set_mode(dev, oldMode);
+        return RFM_OK;
+    }
+
+    /* As in rf69_listen_start(), Listen mode wakes up straight into RX so
+     * the high power PA settings must be off, and no conversion running */
+    if (dev->mode != RFM69_MODE_STDBY)
+        _rf69_set_mode(dev, RFM69_MODE_STDBY);
+    if (_rf69_pa_boost(dev, false) != RFM_OK)
+        return RFM_FAIL;
+    if (dev->temp_running)
+        _rf69_temp_abandon(dev);
+    _rf69_rx_fifo_reset(dev);
+
+    if (_rf69_modify(dev, RFM69_REG_01_OPMODE, RF_OPMODE_LISTEN_ON,
+                RF_OPMODE_LISTEN_ON) != RFM_OK)
+        return RFM_FAIL;
+    dev->listening = true;
+
+    return RFM_OK;
+}
+
+/**
+ * Load an AES-128 key into the RFM69 in one transaction. The key registers
+ * are written in STDBY, and the radio returned to its previous mode.
+ * @param dev The radio to use
+ * @param key The RFM69_AES_KEY_SIZE byte key
+ * @returns RFM_OK for success, RFM_FAIL for failure or if a transmission is
+ * in progress.
+ */
+rfm_status_t rf69_dev_set_aes_key(rf69_dev_t* dev, const rfm_reg_t* key)
+{
+    rfm_reg_t oldMode;
+    rfm_status_t res;
+
+    if (dev->tx_busy)
+        return RFM_FAIL;
+
+    /* This also ends Listen mode */
+    oldMode = dev->mode;
+    if (dev->listening
+            || (oldMode != RFM69_MODE_STDBY && oldMode != RFM69_MODE_SLEEP))
+        _rf69_set_mode(dev, RFM69_MODE_STDBY);
+
+    res = _rf69_burst_write(dev, RFM69_REG_3E_AES_KEY1, key,
+            RFM69_AES_KEY_SIZE);
+
+    if (dev->mode != oldMode)
+        rf69_dev_set_mode(dev, oldMode);
+    return res;
+}
+
+/**
+ * Turn the AES engine on or off, e.g. per packet. Packets sent while it is
+ * on are encrypted with the key from rf69_set_aes_key(), and received ones
+ * decrypted, by the RFM69 itself. Packets are then limited to
+ * RFM69_AES_MAX_LEN bytes, not counting an address byte. Costs nothing if it
+ * is already in that state.
+ * @param dev The radio to use
+ * @param on True to encrypt, false to send and receive plain text
+ * @returns RFM_OK for success, RFM_FAIL for failure or if a transmission is
+ * in progress.
+ */
+rfm_status_t rf69_dev_set_aes(rf69_dev_t* dev, const bool on)
+{
+    rfm_reg_t res;
+
+    if (dev->tx_busy)
+        return RFM_FAIL;
+
+    _rf69_read_cached(dev, RFM69_REG_3D_PACKET_CONFIG2, &res);
+    res = on ? res | RF_PACKET2_AES_ON : res & ~RF_PACKET2_AES_ON;
+    return _rf69_write_cached(dev, RFM69_REG_3D_PACKET_CONFIG2, res);
+}
+
+/**
+ * Check whether the AES engine is on, from the register shadow.
+ * @returns True if it is on, false otherwise.
+ */
+static bool _rf69_aes_on(rf69_dev_t* dev)
+{
+    rfm_reg_t res;
+
+    _rf69_read_cached(dev, RFM69_REG_3D_PACKET_CONFIG2, &res);
+    return res & RF_PACKET2_AES_ON;
+}
+
+/**
+ * Set the node and broadcast addresses of the RFM69 and turn address
+ * filtering on or off. With filtering on, the radio itself drops packets
+ * whose first payload byte matches neither address: they never raise
+ * PayloadReady and are never read over SPI. Received packets then keep the
+ * address byte as the first byte of the buffer, and are counted in its
+ * length. Only the registers whose value changes are written.
+ * @param dev The radio to use
+ * @param node The address of this node
+ * @param broadcast The address every node accepts
+ * @param filtering One of RF_PACKET1_ADRSFILTERING_OFF,
+ * RF_PACKET1_ADRSFILTERING_NODE or RF_PACKET1_ADRSFILTERING_NODEBROADCAST
+ * @returns RFM_OK for success, RFM_FAIL for failure or if a transmission is
+ * in progress.
+ */
+rfm_status_t rf69_dev_set_address(rf69_dev_t* dev, const rfm_reg_t node,
+        const rfm_reg_t broadcast, const rfm_reg_t filtering)
+{
+    rfm_reg_t adrs[2];
+    rfm_reg_t res;
+    bool changed;
+
+    if (dev->tx_busy || (filtering != RF_PACKET1_ADRSFILTERING_OFF
+                && filtering != RF_PACKET1_ADRSFILTERING_NODE
+                && filtering != RF_PACKET1_ADRSFILTERING_NODEBROADCAST))
+        return RFM_FAIL;
+
+    adrs[0] = node;
+    adrs[1] = broadcast;
+    if (_rf69_write_cached_run(dev, RFM69_REG_39_NODE_ADRS, adrs, 2, &changed)
+            != RFM_OK)
+        return RFM_FAIL;
+
+    _rf69_read_cached(dev, RFM69_REG_37_PACKET_CONFIG1, &res);
+    res = (res & ~RF_PACKET1_ADRSFILTERING_MASK) | filtering;
+    return _rf69_write_cached(dev, RFM69_REG_37_PACKET_CONFIG1, res);
+}
+
+/**
+ * Find the address byte for a packet sent without an explicit address: the
+ * broadcast address while address filtering is on, none otherwise.
+ * @param buf Somewhere to put the address byte
+ * @returns buf holding the broadcast address, or NULL for no address byte.
+ */
+static const rfm_reg_t* _rf69_tx_addr(rf69_dev_t* dev, rfm_reg_t* buf)
+{
+    rfm_reg_t res;
+
+    _rf69_read_cached(dev, RFM69_REG_37_PACKET_CONFIG1, &res);
+    if (!(res & RF_PACKET1_ADRSFILTERING_MASK))
+        return NULL;
+
+    _rf69_read_cached(dev, RFM69_REG_3A_BROADCAST_ADRS, buf);
+    return buf;
+}
+
+/**
+ * Turn listen before talk on or off for rf69_send(), rf69_send_start(),
+ * their _to() versions and rf69_tx_flush(). With it on, each send first
+ * enters RX and reads the RSSI. If that is above rssi_dbm, the channel is
+ * busy: the send backs off for a random time of up to the packet's air
+ * time, doubling with each busy reading, and reads the RSSI once more when
+ * the backoff is over. It gives up with RFM_TIMEOUT after RFM69_CSMA_TRIES
+ * busy readings. rf69_send_start() returns RFM_BUSY and leaves the backoff
+ * to rf69_send_poll(), the others wait it out. A clear channel costs one
+ * register read when already in RX.
+ * @param dev The radio to use
+ * @param on True to listen before talking, false to send straight away
+ * @param rssi_dbm The RSSI in dBm above which the channel is busy, e.g. a
+ * few dB above the noise floor
+ * @returns RFM_OK for success, RFM_FAIL if rssi_dbm is out of range.
+ */
+rfm_status_t rf69_dev_set_csma(rf69_dev_t* dev, const bool on,
+        const int16_t rssi_dbm)
+{
+    if (rssi_dbm > 0 || rssi_dbm < -127)
+        return RFM_FAIL;
+
+    dev->csma_on = on;
+    dev->csma_dbm = rssi_dbm;
+    dev->csma_rand ^= _rf69_millis(dev);
+    return RFM_OK;
+}
+
+/**
+ * Get the counters kept by listen before talk, to tune the threshold.
+ * @param dev The radio to use
+ * @param stats Where to copy the counters
+ * @param reset True to zero the counters afterwards
+ * @returns RFM_OK for success, RFM_FAIL for failure.
+ */
+rfm_status_t rf69_dev_csma_stats(rf69_dev_t* dev, rf69_csma_stats_t* stats,
+        const bool reset)
+{
+    *stats = dev->csma_stats;
+    if (reset) {
+        dev->csma_stats.clear = 0;
+        dev->csma_stats.busy = 0;
+        dev->csma_stats.dropped = 0;
+        dev->csma_stats.backoff_ms = 0;
+    }
+    return RFM_OK;
+}
+
+/**
+ * Check once whether the channel is clear before sending, if rf69_set_csma()
+ * is on. When it is busy, csma_until is set to the end of a backoff, after
+ * which the caller checks again. csma_tries counts the busy readings and is
+ * zeroed by the caller before the first check of a send. Leaves the radio in
+ * RX if it had to measure the RSSI.
+ * @param len The length of the packet about to be sent, including any
+ * address byte
+ * @returns RFM_OK if the channel is clear, RFM_BUSY if it is busy, RFM_FAIL
+ * for failure, RFM_TIMEOUT if it was busy RFM69_CSMA_TRIES times.
+ */
+static rfm_status_t _rf69_csma(rf69_dev_t* dev, const uint16_t len)
+{
+    rfm_status_t status;
+    uint32_t window, backoff;
+    rfm_reg_t res;
+
+    if (!dev->csma_on)
+        return RFM_OK;
+
+    /* The RSSI is valid once the receiver is ready */
+    if (dev->mode != RFM69_MODE_RX || dev->listening) {
+        _rf69_set_mode(dev, RFM69_MODE_RX);
+        status = _rf69_wait(dev, RFM69_REG_27_IRQ_FLAGS1,
+                RF_IRQFLAGS1_RXREADY, RF_IRQFLAGS1_RXREADY,
+                _rf69_millis(dev) + RFM69_TIMEOUT_MS);
+        if (status != RFM_OK)
+            return status;
+    }
+
+    if (_rf69_read(dev, RFM69_REG_24_RSSI_VALUE, &res) != RFM_OK)
+        return RFM_FAIL;
+    dev->csma_rand ^= res;
+
+    if (-(int16_t)(res / 2) <= dev->csma_dbm) {
+        dev->csma_stats.clear++;
+        return RFM_OK;
+    }
+    dev->csma_stats.busy++;
+    if (++dev->csma_tries == RFM69_CSMA_TRIES) {
+        dev->csma_stats.dropped++;
+        return RFM_TIMEOUT;
+    }
+
+    /* Binary exponential backoff */
+    window = _rf69_air_ms(dev, len);
+    if (!window)
+        window = 1;
+    backoff = 1 + _rf69_rand(dev) % (window << (dev->csma_tries - 1));
+    dev->csma_stats.backoff_ms += backoff;
+    dev->csma_until = _rf69_millis(dev) + backoff;
+    return RFM_BUSY;
+}
+
+/**
+ * Step the xorshift generator used for backoff times. The RSSI noise mixed
+ * into it by _rf69_csma() keeps nodes that start up together from backing
+ * off in step.
+ * @returns The next pseudo random number.
+ */
+static uint32_t _rf69_rand(rf69_dev_t* dev)
+{
+    uint32_t x = dev->csma_rand;
+
+    if (!x)
+        x = 0x2545F491UL;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    dev->csma_rand = x;
+    return x;
+}
+
+/**
+ * Get the radio driven by the rf69_* functions, for code that takes an
+ * rf69_dev_t such as the hop schedule.
+ * @returns The default device.
+ */
+rf69_dev_t* rf69_default_dev(void)
+{
+    return &_rf69_default;
+}
+
+/**
+ * Default device version of rf69_dev_init().
+ */
+rfm_status_t rf69_init(void)
+{
+    return rf69_dev_init(&_rf69_default, NULL, NULL);
+}
+
+/**
+ * Default device version of rf69_dev_read_temp().
+ */
+rfm_status_t rf69_read_temp(int8_t* temperature)
+{
+    return rf69_dev_read_temp(&_rf69_default, temperature);
+}
+
+/**
+ * Default device version of rf69_dev_temp_start().
+ */
+rfm_status_t rf69_temp_start(void)
+{
+    return rf69_dev_temp_start(&_rf69_default);
+}
+
+/**
+ * Default device version of rf69_dev_temp_poll().
+ */
+rfm_status_t rf69_temp_poll(bool* done, int8_t* temperature)
+{
+    return rf69_dev_temp_poll(&_rf69_default, done, temperature);
+}
+
+/**
+ * Default device version of rf69_dev_temp_cached().
+ */
+rfm_status_t rf69_temp_cached(int8_t* temperature, uint32_t* age_ms)
+{
+    return rf69_dev_temp_cached(&_rf69_default, temperature, age_ms);
+}
+
+/**
+ * Default device version of rf69_dev_receive().
+ */
+rfm_status_t rf69_receive(rfm_reg_t* buf, rfm_reg_t* len, int16_t* lastrssi,
+        bool* rfm_packet_waiting)
+{
+    return rf69_dev_receive(&_rf69_default, buf, len, lastrssi,
+        rfm_packet_waiting);
+}
+
+/**
+ * Default device version of rf69_dev_receive_info().
+ */
+rfm_status_t rf69_receive_info(rfm_reg_t* buf, rfm_reg_t* len,
+        rf69_rx_info_t* info, bool* rfm_packet_waiting)
+{
+    return rf69_dev_receive_info(&_rf69_default, buf, len, info,
+            rfm_packet_waiting);
+}
+
+/**
+ * Default device version of rf69_dev_receive_stream().
+ */
+rfm_status_t rf69_receive_stream(rfm_reg_t* buf, const uint8_t maxlen,
+        uint8_t* len, int16_t* lastrssi, bool* rfm_packet_waiting)
+{
+    return rf69_dev_receive_stream(&_rf69_default, buf, maxlen, len, lastrssi,
+        rfm_packet_waiting);
+}
+
+/**
+ * Default device version of rf69_dev_receive_sink().
+ */
+rfm_status_t rf69_receive_sink(rf69_sink_t sink, void* ctx,
+        bool* rfm_packet_waiting)
+{
+    return rf69_dev_receive_sink(&_rf69_default, sink, ctx, rfm_packet_waiting);
+}
+
+/**
+ * Default device version of rf69_dev_dio0_isr().
+ */
+rfm_status_t rf69_dio0_isr(void)
+{
+    return rf69_dev_dio0_isr(&_rf69_default);
+}
+
+#if RFM69_RX_RING_SIZE
+/**
+ * Default device version of rf69_dev_receive_pop().
+ */
+rfm_status_t rf69_receive_pop(rfm_reg_t* buf, rfm_reg_t* len,
+        int16_t* lastrssi, bool* rfm_packet_waiting)
+{
+    return rf69_dev_receive_pop(&_rf69_default, buf, len, lastrssi,
+        rfm_packet_waiting);
+}
+#endif
+
+/**
+ * Default device version of rf69_dev_send().
+ */
+rfm_status_t rf69_send(const rfm_reg_t* data, uint8_t len, const uint8_t power)
+{
+    return rf69_dev_send(&_rf69_default, data, len, power);
+}
+
+/**
+ * Default device version of rf69_dev_send_start().
+ */
+rfm_status_t rf69_send_start(const rfm_reg_t* data, uint8_t len,
+        const uint8_t power)
+{
+    return rf69_dev_send_start(&_rf69_default, data, len, power);
+}
+
+/**
+ * Default device version of rf69_dev_send_to().
+ */
+rfm_status_t rf69_send_to(const rfm_reg_t addr, const rfm_reg_t* data,
+        uint8_t len, const uint8_t power)
+{
+    return rf69_dev_send_to(&_rf69_default, addr, data, len, power);
+}
+
+/**
+ * Default device version of rf69_dev_send_start_to().
+ */
+rfm_status_t rf69_send_start_to(const rfm_reg_t addr, const rfm_reg_t* data,
+        uint8_t len, const uint8_t power)
+{
+    return rf69_dev_send_start_to(&_rf69_default, addr, data, len, power);
+}
+
+/**
+ * Default device version of rf69_dev_send_poll().
+ */
+rfm_status_t rf69_send_poll(bool* done)
+{
+    return rf69_dev_send_poll(&_rf69_default, done);
+}
+
+#if RFM69_TX_QUEUE_SIZE
+/**
+ * Default device version of rf69_dev_tx_queue().
+ */
+rfm_status_t rf69_tx_queue(const rfm_reg_t* data, uint8_t len)
+{
+    return rf69_dev_tx_queue(&_rf69_default, data, len);
+}
+
+/**
+ * Default device version of rf69_dev_tx_flush().
+ */
+rfm_status_t rf69_tx_flush(const uint8_t power)
+{
+    return rf69_dev_tx_flush(&_rf69_default, power);
+}
+#endif
+
+/**
+ * Default device version of rf69_dev_set_mode().
+ */
+rfm_status_t rf69_set_mode(const rfm_reg_t newMode)
+{
+    return rf69_dev_set_mode(&_rf69_default, newMode);
+}
+
+/**
+ * Default device version of rf69_dev_set_frequency().
+ */
+rfm_status_t rf69_set_frequency(const uint32_t hz)
+{
+    return rf69_dev_set_frequency(&_rf69_default, hz);
+}
+
+/**
+ * Default device version of rf69_dev_set_frf().
+ */
+rfm_status_t rf69_set_frf(const rfm_reg_t* frf)
+{
+    return rf69_dev_set_frf(&_rf69_default, frf);
+}
+
+/**
+ * Default device version of rf69_dev_rssi_sweep().
+ */
+rfm_status_t rf69_rssi_sweep(const uint32_t start_hz, const uint32_t stop_hz,
+        const uint32_t step_hz, int16_t* out)
+{
+    return rf69_dev_rssi_sweep(&_rf69_default, start_hz, stop_hz, step_hz,
+            out);
+}
+
+/**
+ * Default device version of rf69_dev_set_bitrate().
+ */
+rfm_status_t rf69_set_bitrate(const uint32_t bps)
+{
+    return rf69_dev_set_bitrate(&_rf69_default, bps);
+}
+
+/**
+ * Default device version of rf69_dev_apply_profile().
+ */
+rfm_status_t rf69_apply_profile(const rf69_profile_t* profile)
+{
+    return rf69_dev_apply_profile(&_rf69_default, profile);
+}
+
+/**
+ * Default device version of rf69_dev_listen_start().
+ */
+rfm_status_t rf69_listen_start(const uint32_t idle_us, const uint32_t rx_us,
+        const rfm_reg_t criteria)
+{
+    return rf69_dev_listen_start(&_rf69_default, idle_us, rx_us, criteria);
+}
+
+/**
+ * Default device version of rf69_dev_listen_stop().
+ */
+rfm_status_t rf69_listen_stop(void)
+{
+    return rf69_dev_listen_stop(&_rf69_default);
+}
+
+/**
+ * Default device version of rf69_dev_set_aes_key().
+ */
+rfm_status_t rf69_set_aes_key(const rfm_reg_t* key)
+{
+    return rf69_dev_set_aes_key(&_rf69_default, key);
+}
+
+/**
+ * Default device version of rf69_dev_set_aes().
+ */
+rfm_status_t rf69_set_aes(const bool on)
+{
+    return rf69_dev_set_aes(&_rf69_default, on);
+}
+
+/**
+ * Default device version of rf69_dev_set_address().
+ */
+rfm_status_t rf69_set_address(const rfm_reg_t node, const rfm_reg_t broadcast,
+        const rfm_reg_t filtering)
+{
+    return rf69_dev_set_address(&_rf69_default, node, broadcast, filtering);
+}
+
+/**
+ * Default device version of rf69_dev_set_csma().
+ */
+rfm_status_t rf69_set_csma(const bool on, const int16_t rssi_dbm)
+{
+    return rf69_dev_set_csma(&_rf69_default, on, rssi_dbm);
+}
+
+/**
+ * Default device version of rf69_dev_csma_stats().
+ */
+rfm_status_t rf69_csma_stats(rf69_csma_stats_t* stats, const bool reset)
+{
+    return rf69_dev_csma_stats(&_rf69_default, stats, reset);
+}
+
+/**
+ * Default device version of rf69_dev_sample_rssi().
+ */
+rfm_status_t rf69_sample_rssi(int16_t* rssi)
+{
+    return rf69_dev_sample_rssi(&_rf69_default, rssi);
+}
+
+/**
+ * Default device version of rf69_dev_shadow_sync().
+ */
+rfm_status_t rf69_shadow_sync(void)
+{
+    return rf69_dev_shadow_sync(&_rf69_default);
+}
+
+/**
+ * Default device version of rf69_dev_shadow_verify().
+ */
+rfm_status_t rf69_shadow_verify(bool* match)
+{
+    return rf69_dev_shadow_verify(&_rf69_default, match);
 }
 
 /**
@@ -16,7 +16,8 @@
 typedef uint8_t rfm_reg_t;
 
 /* Status codes for return values from library functions */
-typedef enum rfm_status_t { RFM_OK, RFM_FAIL, RFM_TIMEOUT } rfm_status_t;
+typedef enum rfm_status_t { RFM_OK, RFM_FAIL, RFM_TIMEOUT, RFM_BUSY }
+        rfm_status_t;
 
 /* Write commands to the RFM have this bit set */
 #define RFM69_SPI_WRITE_MASK 0x80
@@ -24,19 +25,97 @@ typedef enum rfm_status_t { RFM_OK, RFM_FAIL, RFM_TIMEOUT } rfm_status_t;
 /*
  * This is the maximum message length that can be supported by this library. 
  * Limited by the single message length octet in the header. 
- * Yes, 255 is correct even though the FIFO size in the RF22 is only
- * 64 octets. We use interrupts to refill the Tx FIFO during transmission 
- * and to empty theRx FIFO during reception
+ * Yes, 255 is correct even though the FIFO size in the RFM69 is only
+ * 66 octets. rf69_send_start()/rf69_send_poll() refill the Tx FIFO on
+ * FifoLevel during transmission.
  * Can be pre-defined to a smaller size (to save SRAM) prior to including 
  * this header
  */
-#define RFM69_MAX_MESSAGE_LEN 64
+#ifndef RFM69_MAX_MESSAGE_LEN
+#define RFM69_MAX_MESSAGE_LEN 255
+#endif
 
 /* Max number of octets the RFM69 FIFO can hold */
 #define RFM69_FIFO_SIZE 64
 
+/* Size of an AES-128 key, loaded with rf69_set_aes_key() */
+#define RFM69_AES_KEY_SIZE 16
+
+/* Longest message the AES engine can encrypt, not counting the length byte
+ * or an address byte, which is sent in the clear in front of it */
+#define RFM69_AES_MAX_LEN 64
+
+/*
+ * Number of received packets that rf69_dio0_isr() can hold until the main
+ * loop collects them with rf69_receive_pop(). Must be a power of two, up to
+ * 128. Each slot costs RFM69_FIFO_SIZE + 4 bytes of SRAM. 0 (the default)
+ * leaves out the ring and rf69_receive_pop(), and rf69_dio0_isr() then only
+ * handles PacketSent. Must be the same for the library and everything using it.
+ */
+#ifndef RFM69_RX_RING_SIZE
+#define RFM69_RX_RING_SIZE 0
+#endif
+
+/*
+ * Number of packets that can be queued with rf69_tx_queue() and sent back to
+ * back by rf69_tx_flush(). Each entry costs 3 bytes of SRAM on AVR. 0 (the
+ * default) leaves out the queue, rf69_tx_queue() and rf69_tx_flush(). Must
+ * be the same for the library and everything using it.
+ */
+#ifndef RFM69_TX_QUEUE_SIZE
+#define RFM69_TX_QUEUE_SIZE 0
+#endif
+
+/*
+ * Number of registers each rf69_dev_t keeps a shadow copy of. Must be at
+ * least the number of entries in CONFIG, which the library checks when it is
+ * built.
+ */
+#ifndef RFM69_SHADOW_SIZE
+#define RFM69_SHADOW_SIZE 32
+#endif
+
+/*
+ * FifoLevel threshold used by rf69_receive_stream(). Each poll that sees
+ * FifoLevel reads this many octets in one transaction, and the caller has
+ * RFM69_FIFO_SIZE - RFM69_FIFO_STREAM_LEVEL octets of air time between polls
+ * before the FIFO overruns.
+ */
+#ifndef RFM69_FIFO_STREAM_LEVEL
+#define RFM69_FIFO_STREAM_LEVEL 32
+#endif
+
+/*
+ * Time in ms that the library waits on the radio, measured with spi_millis(),
+ * before giving up with RFM_TIMEOUT. This bounds temperature and RSSI
+ * measurements, and is allowed on top of the air time of a packet being sent.
+ */
+#ifndef RFM69_TIMEOUT_MS
+#define RFM69_TIMEOUT_MS 10
+#endif
+
+/*
+ * Age in ms after which the cached temperature is refreshed, the next time
+ * rf69_set_mode() or the end of a send leaves the radio in STDBY or FS. The
+ * library's own trips through STDBY on the way back to RX don't count.
+ * Define as 0 to only measure the temperature when asked to.
+ */
+#ifndef RFM69_TEMP_REFRESH_MS
+#define RFM69_TEMP_REFRESH_MS 60000UL
+#endif
+
+/*
+ * Number of times a send with rf69_set_csma() on finds the channel busy and
+ * backs off before giving up with RFM_TIMEOUT. The RSSI is sampled once at
+ * the end of each backoff.
+ */
+#ifndef RFM69_CSMA_TRIES
+#define RFM69_CSMA_TRIES 5
+#endif
+
 #define RFM69_MODE_SLEEP    0x00 /* 0.1uA  */
 #define RFM69_MODE_STDBY    0x04 /* 1.25mA */
+#define RFM69_MODE_FS       0x08 /* 9.5mA  */
 #define RFM69_MODE_RX       0x10 /* 16mA   */
 #define RFM69_MODE_TX       0x0c /* >33mA  */
 
@@ -95,11 +174,13 @@ typedef enum rfm_status_t { RFM_OK, RFM_FAIL, RFM_TIMEOUT } rfm_status_t;
 /* Sync values 1-8 go here */
 #define RFM69_REG_37_PACKET_CONFIG1 0x37
 #define RFM69_REG_38_PAYLOAD_LENGTH 0x38
-/* Node address, broadcast address go here */
+#define RFM69_REG_39_NODE_ADRS      0x39
+#define RFM69_REG_3A_BROADCAST_ADRS 0x3A
 #define RFM69_REG_3B_AUTOMODES      0x3B
 #define RFM69_REG_3C_FIFO_THRESHOLD 0x3C
 #define RFM69_REG_3D_PACKET_CONFIG2 0x3D
-/* AES Key 1-16 go here */
+#define RFM69_REG_3E_AES_KEY1       0x3E
+/* AES Key 2-16 go here */
 #define RFM69_REG_4E_TEMP1          0x4E
 #define RFM69_REG_4F_TEMP2          0x4F
 #define RFM69_REG_58_TEST_LNA       0x58
@@ -167,6 +248,14 @@ typedef enum rfm_status_t { RFM_OK, RFM_FAIL, RFM_TIMEOUT } rfm_status_t;
 #define RF_LISTEN1_RESOL_4100                           0xA0
 #define RF_LISTEN1_RESOL_262000                         0xF0
 
+#define RF_LISTEN1_RESOL_IDLE_64                        0x40
+#define RF_LISTEN1_RESOL_IDLE_4100                      0x80
+#define RF_LISTEN1_RESOL_IDLE_262000                    0xC0
+
+#define RF_LISTEN1_RESOL_RX_64                          0x10
+#define RF_LISTEN1_RESOL_RX_4100                        0x20
+#define RF_LISTEN1_RESOL_RX_262000                      0x30
+
 #define RF_LISTEN1_CRITERIA_RSSI                        0x00
 #define RF_LISTEN1_CRITERIA_RSSIANDSYNC                 0x08
 
@@ -649,10 +738,14 @@ typedef enum rfm_status_t { RFM_OK, RFM_FAIL, RFM_TIMEOUT } rfm_status_t;
 #define RF_PACKET1_ADRSFILTERING_OFF                  0x00
 #define RF_PACKET1_ADRSFILTERING_NODE                 0x02
 #define RF_PACKET1_ADRSFILTERING_NODEBROADCAST  0x04
+#define RF_PACKET1_ADRSFILTERING_MASK           0x06
 
 /* RegPayloadLength */
 #define RF_PAYLOADLENGTH_VALUE                  0x40
 
+/* RegNodeAdrs */
+#define RF_NODEADDRESS_VALUE                    0x00
+
 /* RegBroadcastAdrs */
 #define RF_BROADCASTADDRESS_VALUE               0x00
 
@@ -741,15 +834,367 @@ typedef enum rfm_status_t { RFM_OK, RFM_FAIL, RFM_TIMEOUT } rfm_status_t;
 #define RF_TESTLNA_NORMAL                       0x1B
 #define RF_TESTLNA_SENSITIVE                    0x2D
 
+/*
+ * Register values from physical parameters. These are constant expressions,
+ * so when the arguments are constants they are worked out by the compiler and
+ * cost nothing at run time. Frequencies are in Hz, bit rates in bps.
+ */
+
+/* Crystal oscillator frequency */
+#define RFM69_FXOSC                     32000000UL
+
+/* Octet n (0 = LSB) of a multi-register value */
+#define RFM69_BYTE(v, n)        ((rfm_reg_t)(((v) >> (8 * (n))) & 0xFF))
+
+/* RegFrf: carrier frequency in units of Fstep = FXOSC / 2^19 */
+#define RFM69_FRF(hz) \
+    ((uint32_t)((((uint64_t)(hz) << 19) + RFM69_FXOSC / 2) / RFM69_FXOSC))
+
+/* RegBitrate: FXOSC / bit rate */
+#define RFM69_BITRATE(bps) \
+    ((uint16_t)((RFM69_FXOSC + (bps) / 2) / (bps)))
+
+/* RegFdev: frequency deviation in units of Fstep */
+#define RFM69_FDEV(hz) \
+    ((uint16_t)((((uint64_t)(hz) << 19) + RFM69_FXOSC / 2) / RFM69_FXOSC))
+
+/* Single side receiver bandwidth in Hz set by the mantissa and exponent bits
+ * of RegRxBw in FSK mode */
+#define RFM69_RXBW_HZ(reg) \
+    (RFM69_FXOSC / ((16 + (((reg) >> 3) & 0x03) * 4) * (4UL << ((reg) & 0x07))))
+
+/* The mantissa and exponent bits of RegRxBw for the narrowest bandwidth of at
+ * least hz */
+#define _RFM69_RXBW_EXP(hz, e, other) \
+    ((hz) <= RFM69_RXBW_HZ(RF_RXBW_MANT_24 | (e)) ? RF_RXBW_MANT_24 | (e) : \
+     (hz) <= RFM69_RXBW_HZ(RF_RXBW_MANT_20 | (e)) ? RF_RXBW_MANT_20 | (e) : \
+     (hz) <= RFM69_RXBW_HZ(RF_RXBW_MANT_16 | (e)) ? RF_RXBW_MANT_16 | (e) : \
+     (other))
+#define RFM69_RXBW(hz) \
+    _RFM69_RXBW_EXP(hz, 7, _RFM69_RXBW_EXP(hz, 6, _RFM69_RXBW_EXP(hz, 5, \
+    _RFM69_RXBW_EXP(hz, 4, _RFM69_RXBW_EXP(hz, 3, _RFM69_RXBW_EXP(hz, 2, \
+    _RFM69_RXBW_EXP(hz, 1, _RFM69_RXBW_EXP(hz, 0, \
+        RF_RXBW_MANT_16 | RF_RXBW_EXP_0))))))))
+
+/* RegPaRamp: the shortest ramp time of at least us microseconds */
+#define RFM69_PARAMP(us) \
+    ((us) <= 10 ? RF_PARAMP_10 : (us) <= 12 ? RF_PARAMP_12 : \
+     (us) <= 15 ? RF_PARAMP_15 : (us) <= 20 ? RF_PARAMP_20 : \
+     (us) <= 25 ? RF_PARAMP_25 : (us) <= 31 ? RF_PARAMP_31 : \
+     (us) <= 40 ? RF_PARAMP_40 : (us) <= 50 ? RF_PARAMP_50 : \
+     (us) <= 62 ? RF_PARAMP_62 : (us) <= 100 ? RF_PARAMP_100 : \
+     (us) <= 125 ? RF_PARAMP_125 : (us) <= 250 ? RF_PARAMP_250 : \
+     (us) <= 500 ? RF_PARAMP_500 : (us) <= 1000 ? RF_PARAMP_1000 : \
+     (us) <= 2000 ? RF_PARAMP_2000 : RF_PARAMP_3400)
+
+/* Ramp time in microseconds set by RegPaRamp */
+#define RFM69_PARAMP_US(reg) \
+    ((reg) == RF_PARAMP_3400 ? 3400UL : (reg) == RF_PARAMP_2000 ? 2000UL : \
+     (reg) == RF_PARAMP_1000 ? 1000UL : (reg) == RF_PARAMP_500 ? 500UL : \
+     (reg) == RF_PARAMP_250 ? 250UL : (reg) == RF_PARAMP_125 ? 125UL : \
+     (reg) == RF_PARAMP_100 ? 100UL : (reg) == RF_PARAMP_62 ? 62UL : \
+     (reg) == RF_PARAMP_50 ? 50UL : (reg) == RF_PARAMP_40 ? 40UL : \
+     (reg) == RF_PARAMP_31 ? 31UL : (reg) == RF_PARAMP_25 ? 25UL : \
+     (reg) == RF_PARAMP_20 ? 20UL : (reg) == RF_PARAMP_15 ? 15UL : \
+     (reg) == RF_PARAMP_12 ? 12UL : 10UL)
+
+/* InterPacketRxDelay bits of RegPacketConfig2 for a delay of at least the
+ * given number of bit periods */
+#define RFM69_RXRESTARTDELAY(bits) \
+    ((bits) <= 1 ? RF_PACKET2_RXRESTARTDELAY_1BIT : \
+     (bits) <= 2 ? RF_PACKET2_RXRESTARTDELAY_2BITS : \
+     (bits) <= 4 ? RF_PACKET2_RXRESTARTDELAY_4BITS : \
+     (bits) <= 8 ? RF_PACKET2_RXRESTARTDELAY_8BITS : \
+     (bits) <= 16 ? RF_PACKET2_RXRESTARTDELAY_16BITS : \
+     (bits) <= 32 ? RF_PACKET2_RXRESTARTDELAY_32BITS : \
+     (bits) <= 64 ? RF_PACKET2_RXRESTARTDELAY_64BITS : \
+     (bits) <= 128 ? RF_PACKET2_RXRESTARTDELAY_128BITS : \
+     (bits) <= 256 ? RF_PACKET2_RXRESTARTDELAY_256BITS : \
+     (bits) <= 512 ? RF_PACKET2_RXRESTARTDELAY_512BITS : \
+     (bits) <= 1024 ? RF_PACKET2_RXRESTARTDELAY_1024BITS : \
+     RF_PACKET2_RXRESTARTDELAY_2048BITS)
+
+/* Fails the build if cond, a constant expression, is false */
+#define RFM69_STATIC_ASSERT(cond, name) \
+    typedef char rfm69_assert_##name[(cond) ? 1 : -1]
+
+/* A received packet held in the interrupt-fed ring */
+typedef struct rf69_packet_t {
+    rfm_reg_t len;
+    int16_t rssi;
+    rfm_reg_t data[RFM69_FIFO_SIZE];
+} rf69_packet_t;
+
+/* Number of RSSI values rf69_rssi_sweep() writes for a range */
+#define RFM69_SWEEP_POINTS(start_hz, stop_hz, step_hz) \
+    (((stop_hz) - (start_hz)) / (step_hz) + 1)
+
+/*
+ * What rf69_receive_info() knows about a received packet, besides its data.
+ */
+typedef struct rf69_rx_info_t {
+    /* Signal strength in dBm, held by the radio from the sync word */
+    int16_t rssi;
+    /* Carrier offset of the transmitter as measured by the FEI block, and
+     * the correction AFC applied for this packet, in Hz */
+    int32_t fei_hz;
+    int32_t afc_hz;
+    /* When the packet was collected, from spi_millis() */
+    uint32_t ms;
+} rf69_rx_info_t;
+
+/*
+ * Counters kept by rf69_set_csma(), read with rf69_csma_stats().
+ */
+typedef struct rf69_csma_stats_t {
+    /* Channel assessments that found the channel clear, and busy */
+    uint16_t clear;
+    uint16_t busy;
+    /* Sends given up after RFM69_CSMA_TRIES busy assessments */
+    uint16_t dropped;
+    /* Total time spent backing off, in ms */
+    uint32_t backoff_ms;
+} rf69_csma_stats_t;
+
+/*
+ * Called by rf69_receive_sink() with the length and RSSI of a received packet
+ * while the FIFO is being read. Returns where the len payload bytes should go,
+ * e.g. a free slot in the caller's packet pool, or NULL to drop the packet.
+ * Runs with the SPI slave selected so must not talk to the RFM69.
+ */
+typedef rfm_reg_t* (*rf69_sink_t)(void* ctx, uint8_t len, int16_t rssi);
+
+/*
+ * A set of radio parameters that can be switched to with rf69_apply_profile().
+ * Holds the register values, so build it with RFM69_PROFILE() to have them
+ * worked out at compile time.
+ */
+typedef struct rf69_profile_t {
+    /* RegBitrateMsb through RegFrfLsb (0x03 - 0x09) */
+    rfm_reg_t regs[7];
+    /* Mantissa and exponent bits of RegRxBw */
+    rfm_reg_t rxbw;
+} rf69_profile_t;
+
+#define RFM69_PROFILE(freq_hz, bitrate_bps, fdev_hz, rxbw_hz) \
+    { { RFM69_BYTE(RFM69_BITRATE(bitrate_bps), 1), \
+        RFM69_BYTE(RFM69_BITRATE(bitrate_bps), 0), \
+        RFM69_BYTE(RFM69_FDEV(fdev_hz), 1), \
+        RFM69_BYTE(RFM69_FDEV(fdev_hz), 0), \
+        RFM69_BYTE(RFM69_FRF(freq_hz), 2), \
+        RFM69_BYTE(RFM69_FRF(freq_hz), 1), \
+        RFM69_BYTE(RFM69_FRF(freq_hz), 0) }, \
+      RFM69_RXBW(rxbw_hz) }
+
+/*
+ * How to reach one RFM69, for boards with more than one radio. Each function
+ * is passed the ctx from the rf69_dev_t. init and exchange_burst may be NULL,
+ * in which case the bus is assumed to be set up already and each byte goes
+ * through exchange_single. millis may be NULL to use spi_millis().
+ */
+typedef struct rf69_spi_ops_t {
+    rfm_status_t (*init)(void* ctx);
+    rfm_status_t (*exchange_single)(void* ctx, const rfm_reg_t out,
+            rfm_reg_t* in);
+    rfm_status_t (*exchange_burst)(void* ctx, const rfm_reg_t* out,
+            rfm_reg_t* in, uint8_t len);
+    rfm_status_t (*ss_assert)(void* ctx);
+    rfm_status_t (*ss_deassert)(void* ctx);
+    uint32_t (*millis)(void* ctx);
+} rf69_spi_ops_t;
+
+/*
+ * All of the driver state for one RFM69. Set up with rf69_dev_init(); the
+ * fields are private to the library.
+ */
+typedef struct rf69_dev_t {
+    /* SPI access, NULL for the spi_conf.h functions */
+    const rf69_spi_ops_t* spi;
+    void* ctx;
+
+    /* Current mode of the radio, and Listen mode is on */
+    rfm_reg_t mode;
+    bool listening;
+
+    /* Shadow copy of every register in CONFIG, in the same order */
+    rfm_reg_t shadow[RFM69_SHADOW_SIZE];
+    bool shadow_valid;
+
+    /* The high power PA registers are engaged (and OCP is off) */
+    bool pa_boost;
+
+    /* Packets received by rf69_dev_dio0_isr() and free-running indices,
+     * written by the ISR and main loop only */
+#if RFM69_RX_RING_SIZE
+    rf69_packet_t rx_ring[RFM69_RX_RING_SIZE];
+    volatile uint8_t rx_head, rx_tail;
+#endif
+
+    /* Progress through the frame being read by rf69_dev_receive_stream() */
+    bool rxs_active;
+    uint8_t rxs_len, rxs_got;
+    int16_t rxs_rssi;
+
+    /* Asynchronous transmission in progress, PacketSent seen by the ISR,
+     * mode to return to, whether to listen again afterwards and the part of
+     * a long packet still to load */
+    volatile bool tx_busy;
+    volatile bool tx_done;
+    rfm_reg_t tx_old_mode;
+    bool tx_listen;
+    const rfm_reg_t* tx_src;
+    uint8_t tx_left;
+
+    /* A send held back by listen before talk, whose data and length are in
+     * tx_src and tx_left, with its address byte (if tx_to) and power */
+    bool tx_backoff;
+    bool tx_to;
+    rfm_reg_t tx_addr;
+    uint8_t tx_power;
+
+    /* Packets waiting for rf69_dev_tx_flush() */
+#if RFM69_TX_QUEUE_SIZE
+    const rfm_reg_t* txq_data[RFM69_TX_QUEUE_SIZE];
+    uint8_t txq_len[RFM69_TX_QUEUE_SIZE];
+    uint8_t txq_count;
+#endif
+
+    /* Last temperature reading and when it was taken, when a conversion was
+     * last started, and one in progress, with the mode to return to if
+     * rf69_dev_temp_start() left RX or SLEEP */
+    int8_t temp;
+    bool temp_valid;
+    uint32_t temp_ms;
+    uint32_t temp_try_ms;
+    bool temp_running;
+    bool temp_restore;
+    rfm_reg_t temp_old_mode;
+    uint32_t temp_deadline;
+
+    /* Listen before talk is on, the RSSI above which the channel is busy,
+     * the xorshift state for backoffs, busy readings for the current send,
+     * when its backoff ends and what happened so far */
+    bool csma_on;
+    int16_t csma_dbm;
+    uint32_t csma_rand;
+    uint8_t csma_tries;
+    uint32_t csma_until;
+    rf69_csma_stats_t csma_stats;
+} rf69_dev_t;
+
 /* Public prototypes here */
 rfm_status_t rf69_init(void);
 rfm_status_t rf69_read_temp(int8_t* temperature);
+rfm_status_t rf69_temp_start(void);
+rfm_status_t rf69_temp_poll(bool* done, int8_t* temperature);
+rfm_status_t rf69_temp_cached(int8_t* temperature, uint32_t* age_ms);
 rfm_status_t rf69_receive(rfm_reg_t* buf, rfm_reg_t* len, int16_t* lastrssi,
         bool* rfm_packet_waiting);
+rfm_status_t rf69_receive_info(rfm_reg_t* buf, rfm_reg_t* len,
+        rf69_rx_info_t* info, bool* rfm_packet_waiting);
+rfm_status_t rf69_receive_stream(rfm_reg_t* buf, const uint8_t maxlen,
+        uint8_t* len, int16_t* lastrssi, bool* rfm_packet_waiting);
+rfm_status_t rf69_receive_sink(rf69_sink_t sink, void* ctx,
+        bool* rfm_packet_waiting);
+rfm_status_t rf69_dio0_isr(void);
+#if RFM69_RX_RING_SIZE
+rfm_status_t rf69_receive_pop(rfm_reg_t* buf, rfm_reg_t* len,
+        int16_t* lastrssi, bool* rfm_packet_waiting);
+#endif
 rfm_status_t rf69_send(const rfm_reg_t* data, uint8_t len, 
         const uint8_t power);
+rfm_status_t rf69_send_start(const rfm_reg_t* data, uint8_t len,
+        const uint8_t power);
+rfm_status_t rf69_send_to(const rfm_reg_t addr, const rfm_reg_t* data,
+        uint8_t len, const uint8_t power);
+rfm_status_t rf69_send_start_to(const rfm_reg_t addr, const rfm_reg_t* data,
+        uint8_t len, const uint8_t power);
+rfm_status_t rf69_send_poll(bool* done);
+#if RFM69_TX_QUEUE_SIZE
+rfm_status_t rf69_tx_queue(const rfm_reg_t* data, uint8_t len);
+rfm_status_t rf69_tx_flush(const uint8_t power);
+#endif
 rfm_status_t rf69_set_mode(const rfm_reg_t newMode);
+rfm_status_t rf69_set_frequency(const uint32_t hz);
+rfm_status_t rf69_set_frf(const rfm_reg_t* frf);
+rfm_status_t rf69_frf_bytes(const uint32_t hz, rfm_reg_t* frf);
+rfm_status_t rf69_set_bitrate(const uint32_t bps);
+rfm_status_t rf69_apply_profile(const rf69_profile_t* profile);
+rfm_status_t rf69_listen_start(const uint32_t idle_us, const uint32_t rx_us,
+        const rfm_reg_t criteria);
+rfm_status_t rf69_listen_stop(void);
+rfm_status_t rf69_set_aes_key(const rfm_reg_t* key);
+rfm_status_t rf69_set_aes(const bool on);
+rfm_status_t rf69_set_address(const rfm_reg_t node, const rfm_reg_t broadcast,
+        const rfm_reg_t filtering);
+rfm_status_t rf69_set_csma(const bool on, const int16_t rssi_dbm);
+rfm_status_t rf69_csma_stats(rf69_csma_stats_t* stats, const bool reset);
 rfm_status_t rf69_sample_rssi(int16_t* rssi);
+rfm_status_t rf69_rssi_sweep(const uint32_t start_hz, const uint32_t stop_hz,
+        const uint32_t step_hz, int16_t* out);
+rfm_status_t rf69_shadow_sync(void);
+rfm_status_t rf69_shadow_verify(bool* match);
+rf69_dev_t* rf69_default_dev(void);
+
+/* The same, for a particular radio */
+rfm_status_t rf69_dev_init(rf69_dev_t* dev, const rf69_spi_ops_t* spi,
+        void* ctx);
+rfm_status_t rf69_dev_read_temp(rf69_dev_t* dev, int8_t* temperature);
+rfm_status_t rf69_dev_temp_start(rf69_dev_t* dev);
+rfm_status_t rf69_dev_temp_poll(rf69_dev_t* dev, bool* done,
+        int8_t* temperature);
+rfm_status_t rf69_dev_temp_cached(rf69_dev_t* dev, int8_t* temperature,
+        uint32_t* age_ms);
+rfm_status_t rf69_dev_receive(rf69_dev_t* dev, rfm_reg_t* buf, rfm_reg_t* len,
+        int16_t* lastrssi, bool* rfm_packet_waiting);
+rfm_status_t rf69_dev_receive_info(rf69_dev_t* dev, rfm_reg_t* buf,
+        rfm_reg_t* len, rf69_rx_info_t* info, bool* rfm_packet_waiting);
+rfm_status_t rf69_dev_receive_stream(rf69_dev_t* dev, rfm_reg_t* buf,
+        const uint8_t maxlen, uint8_t* len, int16_t* lastrssi,
+        bool* rfm_packet_waiting);
+rfm_status_t rf69_dev_receive_sink(rf69_dev_t* dev, rf69_sink_t sink,
+        void* ctx, bool* rfm_packet_waiting);
+rfm_status_t rf69_dev_dio0_isr(rf69_dev_t* dev);
+#if RFM69_RX_RING_SIZE
+rfm_status_t rf69_dev_receive_pop(rf69_dev_t* dev, rfm_reg_t* buf,
+        rfm_reg_t* len, int16_t* lastrssi, bool* rfm_packet_waiting);
+#endif
+rfm_status_t rf69_dev_send(rf69_dev_t* dev, const rfm_reg_t* data,
+        uint8_t len, const uint8_t power);
+rfm_status_t rf69_dev_send_start(rf69_dev_t* dev, const rfm_reg_t* data,
+        uint8_t len, const uint8_t power);
+rfm_status_t rf69_dev_send_to(rf69_dev_t* dev, const rfm_reg_t addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power);
+rfm_status_t rf69_dev_send_start_to(rf69_dev_t* dev, const rfm_reg_t addr,
+        const rfm_reg_t* data, uint8_t len, const uint8_t power);
+rfm_status_t rf69_dev_send_poll(rf69_dev_t* dev, bool* done);
+#if RFM69_TX_QUEUE_SIZE
+rfm_status_t rf69_dev_tx_queue(rf69_dev_t* dev, const rfm_reg_t* data,
+        uint8_t len);
+rfm_status_t rf69_dev_tx_flush(rf69_dev_t* dev, const uint8_t power);
+#endif
+rfm_status_t rf69_dev_set_mode(rf69_dev_t* dev, const rfm_reg_t newMode);
+rfm_status_t rf69_dev_set_frequency(rf69_dev_t* dev, const uint32_t hz);
+rfm_status_t rf69_dev_set_frf(rf69_dev_t* dev, const rfm_reg_t* frf);
+rfm_status_t rf69_dev_set_bitrate(rf69_dev_t* dev, const uint32_t bps);
+rfm_status_t rf69_dev_apply_profile(rf69_dev_t* dev,
+        const rf69_profile_t* profile);
+rfm_status_t rf69_dev_listen_start(rf69_dev_t* dev, const uint32_t idle_us,
+        const uint32_t rx_us, const rfm_reg_t criteria);
+rfm_status_t rf69_dev_listen_stop(rf69_dev_t* dev);
+rfm_status_t rf69_dev_set_aes_key(rf69_dev_t* dev, const rfm_reg_t* key);
+rfm_status_t rf69_dev_set_aes(rf69_dev_t* dev, const bool on);
+rfm_status_t rf69_dev_set_address(rf69_dev_t* dev, const rfm_reg_t node,
+        const rfm_reg_t broadcast, const rfm_reg_t filtering);
+rfm_status_t rf69_dev_set_csma(rf69_dev_t* dev, const bool on,
+        const int16_t rssi_dbm);
+rfm_status_t rf69_dev_csma_stats(rf69_dev_t* dev, rf69_csma_stats_t* stats,
+        const bool reset);
+rfm_status_t rf69_dev_sample_rssi(rf69_dev_t* dev, int16_t* rssi);
+rfm_status_t rf69_dev_rssi_sweep(rf69_dev_t* dev, const uint32_t start_hz,
+        const uint32_t stop_hz, const uint32_t step_hz, int16_t* out);
+rfm_status_t rf69_dev_shadow_sync(rf69_dev_t* dev);
+rfm_status_t rf69_dev_shadow_verify(rf69_dev_t* dev, bool* match);
 
 /**
  * SPI device driver functions. These are to be provided by the user.
@@ -760,6 +1205,14 @@ rfm_status_t spi_init(void);
 rfm_status_t spi_exchange_single(const rfm_reg_t out, rfm_reg_t* in);
 rfm_status_t spi_ss_assert(void);
 rfm_status_t spi_ss_deassert(void);
+uint32_t spi_millis(void);
+
+/**
+ * Optional bulk transfer, used by the library when the user's spi_conf.h
+ * defines SPI_HAVE_EXCHANGE_BURST. Either buffer may be NULL.
+ */
+rfm_status_t spi_exchange_burst(const rfm_reg_t* out, rfm_reg_t* in,
+        uint8_t len);
 
 #endif /* __RFM69_H__ */
 